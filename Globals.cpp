@@ -1,24 +1,39 @@
 #include "Globals.hpp"
 #include "utils.hpp"
+#include "bfs.hpp"
+#include "budget.hpp"
+#include "numa.hpp"
+#include "pipeline.hpp"
+#include "shard.hpp"
+#include "symmetry.hpp"
 #include <thread> 
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
 #include <boost/program_options/parsers.hpp>
+#include <memory>
 #include <tbb/concurrent_set.h>
+#include <tbb/global_control.h>
 #include <omp.h>
 
 namespace po = boost::program_options;
 
 // Threading and performance tracking
 uint8_t THREADS; //store maximum number of threads here
-omp_lock_t omp_lock;
+static std::unique_ptr<tbb::global_control> thread_limit;  // Caps every TBB parallel algorithm at THREADS
 std::chrono::high_resolution_clock::time_point tcount_init_time = std::chrono::high_resolution_clock::now(); // Initialize with current time
 std::chrono::duration<double> timeelapsed = std::chrono::duration<double>::zero(); // Initialize as zero
 
 // Pattern handling and search settings
 tbb::concurrent_set<pattern> pattern_set;         
 std::string pattern_file = "";
+std::string pattern_convert_file = "";
 std::string case_file = "";
+std::string pipeline_spec = "";
+std::string stats_file = "";
+std::string query_file = "";
+std::string read_dat_file = "";
+std::vector<std::string> dat_convert_paths;
+std::string serve_target = "";
 std::string root_string ="";
 SO6 root = SO6::identity();
 
@@ -27,6 +42,17 @@ uint8_t target_T_count = 8;
 uint8_t stored_depth_max = 255;
 uint8_t num_gen_sets = 1;
 bool cases_flag = false;
+bool numa_flag = false;
+bool binary_output = false;
+bool compress_output = false;
+bool save_layers_flag = false;
+int merge_shard_count = 0;
+double stats_interval = 1;
+bool plain_log = false;
+bool transpose_multiply = false;
+bool no_prune = false;
+size_t targeted_threshold = 0;
+int serve_depth = 0;
 
 // // Counters
 int counter_zero = 0;
@@ -40,16 +66,38 @@ void Globals::setParameters(int argc, char *argv[]) {
         int tcount_param;
         int stored_depth_param;
         int threads_param;
+        std::string shard_spec;
+        std::string memory_budget_spec;
 
         desc.add_options()
             ("help,h", "produce help message")
             ("tcount,t", po::value<int>(&tcount_param)->default_value(8), "target T count")
             ("stored_depth,s", po::value<int>(&stored_depth_param)->default_value(0), "maximum stored depth")
-            ("pattern_file,f", po::value<std::string>(&pattern_file), "pattern file")
+            ("pattern_file,f", po::value<std::string>(&pattern_file), "pattern file (text, CSV or binary)")
+            ("convert_patterns,x", po::value<std::string>(&pattern_convert_file), "convert the text or CSV pattern file to a binary pattern file at this path and exit")
             ("verbose,v", po::bool_switch(), "enable verbosity")
             ("threads,n", po::value<std::string>()->default_value(std::to_string(std::thread::hardware_concurrency()-1)), "number of threads")
             ("root,r", po::value<std::string>(), "set the root of the search tree by specifying a circuit.")
-            ("cases,c", po::bool_switch(&cases_flag), "flag to tell code whether we are looking for specific cases (not used).");
+            ("cases,c", po::bool_switch(&cases_flag), "flag to tell code whether we are looking for specific cases (not used).")
+            ("binary_output,b", po::bool_switch(&binary_output), "write circuits as nibble-packed binary records instead of text")
+            ("compress_output,z", po::bool_switch(&compress_output), "write circuits as binary records in compressed blocks that each decode on their own, compressed on the writer thread")
+            ("read_dat", po::value<std::string>(&read_dat_file), "print the circuits of a text or binary circuit file, crossing their patterns off the pattern file, and exit")
+            ("convert_dat", po::value<std::vector<std::string>>(&dat_convert_paths)->multitoken(), "convert a circuit file given as the input and output paths, text to binary or binary to text, and exit")
+            ("save_layers", po::bool_switch(&save_layers_flag), "run the BFS phase, save the stored layer and generating sets to ./data/layers for --shard runs, and exit")
+            ("shard", po::value<std::string>(&shard_spec), "run slice i of N of the free multiply phase from the saved layers, given as i/N")
+            ("merge", po::value<int>(&merge_shard_count), "merge the outputs and coverage of N shard runs into ./data and exit")
+            ("numa", po::bool_switch(&numa_flag), "shard layers and generating sets by NUMA node and pin threads to their node")
+            ("pipeline", po::value<std::string>(&pipeline_spec)->implicit_value("auto"), "expand BFS layers as a staged pipeline, optionally with the threads of the expand, dedup and pattern stages as e,d,p")
+            ("stats_file", po::value<std::string>(&stats_file), "periodically write throughput, dedup hit rate, patterns remaining, ETA and layer sizes to this JSON file")
+            ("stats_interval", po::value<double>(&stats_interval)->default_value(1), "seconds between progress reports")
+            ("log", po::bool_switch(&plain_log), "print progress as plain lines without terminal escape codes, for output redirected to a file")
+            ("query", po::value<std::string>(&query_file), "print a least T count circuit for every circuit or matrix in this file, one per line, searching up to the target T count, and exit")
+            ("serve", po::value<std::string>(&serve_target)->implicit_value("-"), "keep the layers from the identity resident and answer batches of queries on this Unix socket, or on stdin if no path is given")
+            ("serve_depth", po::value<int>(&serve_depth)->default_value(0), "T count of the resident layers when serving, half the target T count if 0")
+            ("transpose", po::bool_switch(&transpose_multiply), "store one class of every pair of inverse classes in each layer, expanding the other on demand")
+            ("no_prune", po::bool_switch(&no_prune), "form every child in the BFS, including those that cancel a T matrix of their parent's circuit or share a sibling's class")
+            ("targeted", po::value<size_t>(&targeted_threshold)->implicit_value(2), "once at most this many of the 8 target pattern cases remain, free multiply only the products that may still have a target case")
+            ("memory_budget", po::value<std::string>(&memory_budget_spec), "choose the stored depth while the BFS runs, as the one with the least projected run time whose layers fit in this much memory, such as 48G");
         po::variables_map vm;
         po::store(po::parse_command_line(argc, argv, desc), vm);
         po::notify(vm);
@@ -63,6 +111,10 @@ void Globals::setParameters(int argc, char *argv[]) {
             std::exit(EXIT_SUCCESS);
         }
 
+        if (!dat_convert_paths.empty() && dat_convert_paths.size() != 2) throw po::error("--convert_dat takes an input and an output path");
+        if (!shard_spec.empty()) shard::configure(shard_spec);
+        if (!memory_budget_spec.empty()) budget::configure(budget::parse(memory_budget_spec));
+
         if (vm.count("threads")) {
             if(vm["threads"].as<std::string>() == "max") {
                 THREADS = std::thread::hardware_concurrency();
@@ -78,9 +130,25 @@ void Globals::setParameters(int argc, char *argv[]) {
     } 
 }
 
+/**
+ * @brief Sets the number of threads used by both the TBB and OpenMP runtimes.
+ * @param threads Number of threads, including the calling thread.
+ */
+void Globals::limit_threads(const int threads)
+{
+    thread_limit.reset();   // Only one limit may be active, so drop the old one first
+    thread_limit = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, threads);
+    omp_set_num_threads(threads);
+}
+
 // Configure run based on global parameters
 void Globals::configure()
 {
+    if (budget::active() && shard::active()) {
+        std::cout << "[Config] Ignoring --memory_budget, shards use the stored depth of the saved layers.\n";
+        budget::configure(0);
+    }
+    if (budget::active()) stored_depth_max = 0;     // The BFS stops where the budget says, at most at T-1
     if (stored_depth_max == 0 || stored_depth_max > target_T_count-1) stored_depth_max = target_T_count-1;
     if (stored_depth_max < std::ceil((float)target_T_count/2)) stored_depth_max = (uint8_t) std::ceil((float)target_T_count/2); 
     
@@ -89,11 +157,63 @@ void Globals::configure()
     } else if(THREADS <= 0) {
         THREADS = 1;
     }
+    limit_threads(THREADS);
 
     // Output configuration
     std::cout << "[Config] Generating up to T=" << (int) target_T_count << ".\n";
     std::cout << "[Config] Storing at most T=" << (int) stored_depth_max << " in memory.\n";
+    if (budget::active()) {
+        std::cout << "[Config] Memory budget of " << (budget::limit() >> 20) << " MB, storing from T=" << budget::lowest_depth(target_T_count)
+                  << " to T=" << (int) stored_depth_max << " as the BFS measures its layers.\n";
+    }
     std::cout << "[Config] Running on " << (int) THREADS << " threads.\n";
+    if (numa_flag) {
+        numa::configure(THREADS);
+        std::cout << "[Config] NUMA mode with " << numa::shards() << " shards.\n";
+    }
+    if (shard::active()) {
+        std::cout << "[Config] Running shard " << shard::index() << " of " << shard::total() << " from the layers saved in " << shard::LAYER_DIR << ".\n";
+    }
+    if (!pipeline_spec.empty() && numa_flag) {
+        std::cout << "[Config] Ignoring --pipeline, which does not run on NUMA shards.\n";
+    } else if (!pipeline_spec.empty()) {
+        try {
+            pipeline::configure(pipeline_spec, THREADS);
+        } catch (std::exception& e) {
+            std::cerr << "Error: invalid --pipeline " << pipeline_spec << ": " << e.what() << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+        std::cout << "[Config] Pipelined BFS with " << pipeline::threads(pipeline::EXPAND) << " expand, "
+                  << pipeline::threads(pipeline::DEDUP) << " dedup and " << pipeline::threads(pipeline::PATTERN) << " pattern threads.\n";
+    }
+    if (transpose_multiply && (!query_file.empty() || !serve_target.empty())) {
+        std::cout << "[Config] Ignoring --transpose, which queries do not use.\n";
+    } else if (transpose_multiply) {
+        symmetry::enable(true);
+        std::cout << "[Config] Transpose symmetry: one class of every inverse pair per layer.\n";
+    }
+    if (no_prune) {
+        bfs::prune(false);
+        std::cout << "[Config] Forming every child of every node.\n";
+    }
+    if (stats_interval <= 0) stats_interval = 1;
+    if (!stats_file.empty()) {
+        std::cout << "[Config] Writing stats to " << stats_file << " every " << stats_interval << "s.\n";
+    }
+    if (plain_log) {
+        std::cout << "[Config] Plain progress log.\n";
+    }
+    if (targeted_threshold > 0) {
+        std::cout << "[Config] Targeted free multiply once at most " << targeted_threshold << " target cases remain.\n";
+    }
+    if (!query_file.empty()) {
+        std::cout << "[Config] Answering the queries in " << query_file << " up to T=" << (int) target_T_count << ".\n";
+    }
+    if (!serve_target.empty()) {
+        if (serve_depth <= 0) serve_depth = (int) std::ceil((float) target_T_count / 2);
+        std::cout << "[Config] Serving queries up to T=" << (int) target_T_count << " on " << (serve_target == "-" ? "stdin" : serve_target)
+                  << " with layers to T=" << serve_depth << " resident.\n";
+    }
     if (!pattern_file.empty()) {
         std::cout << "[Config] Searching for patterns in file " << pattern_file << "\n";
     } else {
@@ -124,10 +244,6 @@ void Globals::configure()
     //     std::cout << "[Config] Verbose mode enabled.\n";
     // }
 
-    // if (transpose_multiply) {
-    //     std::cout << "[Config] Transpose multiply enabled.\n";
-    // }
-
     // if (explicit_search_mode) {
     //     std::cout << "[Config] Explicit search mode enabled.\n";
     // }
@@ -11,14 +11,20 @@
 
 // Threading and performance tracking
 extern uint8_t THREADS;
-extern omp_lock_t omp_lock;
 extern std::chrono::high_resolution_clock::time_point tcount_init_time;
 extern std::chrono::duration<double> timeelapsed;
 
 // Pattern handling and search settings
 extern tbb::concurrent_set<pattern> pattern_set;
 extern std::string pattern_file;
+extern std::string pattern_convert_file;
 extern std::string case_file;
+extern std::string pipeline_spec;
+extern std::string stats_file;
+extern std::string query_file;
+extern std::string read_dat_file;
+extern std::vector<std::string> dat_convert_paths;
+extern std::string serve_target;
 extern SO6 root;
 extern std::string root_string;
 
@@ -29,8 +35,18 @@ extern uint8_t num_gen_sets;
 extern bool saveResults;
 extern bool verbose;
 extern bool transpose_multiply;
+extern bool no_prune;
 extern bool explicit_search_mode;
 extern bool cases_flag;
+extern bool numa_flag;
+extern bool binary_output;
+extern bool compress_output;
+extern bool save_layers_flag;
+extern int merge_shard_count;
+extern double stats_interval;
+extern bool plain_log;
+extern size_t targeted_threshold;
+extern int serve_depth;
 
 // Counters
 extern int counter_zero;
@@ -41,5 +57,6 @@ class Globals {
     public:
         static void setParameters(int argc, char *argv[]);
         static void configure();
+        static void limit_threads(const int threads);
 };
 #endif // GLOBALS_HPP
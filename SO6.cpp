@@ -1,3 +1,4 @@
+#include <array>
 #include <iomanip>  // For std::setw
 #include <sstream>
 #include <boost/format.hpp>
@@ -21,6 +22,51 @@ constexpr auto Less = std::strong_ordering::less;
 constexpr auto Greater = std::strong_ordering::greater;
 constexpr auto Equivalent = std::strong_ordering::equivalent;
 
+/**
+ * @brief The two rows each T matrix mixes, by index.
+ */
+static constexpr int T_PLANE[15][2] = {{0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5}, {1, 2}, {1, 3}, {1, 4},
+                                       {1, 5}, {2, 3}, {2, 4}, {2, 5}, {3, 4}, {3, 5}, {4, 5}};
+
+/**
+ * @brief Orbits of the 15 planes under permutations of the six rows, as a union-find forest whose
+ *        roots are the least plane of each orbit.
+ */
+struct plane_orbits {
+    uint8_t parent[15];
+
+    plane_orbits() { reset(); }
+    void reset() { for (uint8_t p = 0; p < 15; ++p) parent[p] = p; }
+
+    int find(int p) {
+        while (parent[p] != p) p = parent[p] = parent[parent[p]];
+        return p;
+    }
+
+    /**
+     * @brief Joins every plane with its image under the permutation sending from[k] to to[k].
+     */
+    void join(const uint8_t *from, const uint8_t *to) {
+        static constexpr auto plane_of = [] {
+            std::array<std::array<uint8_t, 6>, 6> index{};
+            for (uint8_t p = 0; p < 15; ++p) index[T_PLANE[p][0]][T_PLANE[p][1]] = index[T_PLANE[p][1]][T_PLANE[p][0]] = p;
+            return index;
+        }();
+        uint8_t image[6];
+        for (int k = 0; k < 6; ++k) image[from[k]] = to[k];
+        for (int p = 0; p < 15; ++p) {
+            const int a = find(p), b = find(plane_of[image[T_PLANE[p][0]]][image[T_PLANE[p][1]]]);
+            if (a != b) parent[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    uint16_t representatives() {
+        uint16_t mask = 0;
+        for (int p = 0; p < 15; ++p) if (find(p) == p) mask |= 1 << p;
+        return mask;
+    }
+};
+
 /**
  * Basic constructor. Initializes Zero matrix.
  *
@@ -48,6 +94,23 @@ SO6::SO6(pattern &other)
 
 }
 
+/**
+ * @brief Initializes a matrix from its entries and brings it into canonical form.
+ * @param entries The entries, entries[row][col]. Each must be in the reduced form the other methods produce.
+ */
+SO6::SO6(Z2 entries[6][6])
+{
+    for (int col = 0; col < 6; col++) {
+        for (int row = 0; row < 6; row++) {
+            arr[get_index(row, col)] = entries[row][col];
+            row_frequency[row][entries[row][col].abs()]++;
+            col_frequency[col][entries[row][col].abs()]++;
+        }
+    }
+    refresh_pattern();
+    canonical_form();
+}
+
 // Something much faster than this would be a "multiply by T" method that explicitly does the matrix multiplication given a particular T matrix instead of trying to compute it naively
 
 /**
@@ -69,7 +132,7 @@ SO6 SO6::operator*(const SO6 &other) const
     {
         for (int k = 0; k < 6; ++k)
         {
-            const Z2& left_element = *this[k][row];
+            const Z2& left_element = (*this)[k][row];
             if (left_element.intPart == 0) continue;
             for (int col = 0; col < 6; ++col)
             {
@@ -81,25 +144,25 @@ SO6 SO6::operator*(const SO6 &other) const
     return prod;
 }
 
-SO6 SO6::left_multiply_by_T(const int i) const
+SO6 SO6::left_multiply_by_T(const int i, const bool canonical) const
 {
     SO6 prod = *this;
     switch (i) {
-        case 0: return left_multiply_by_T<0>(prod);
-        case 1: return left_multiply_by_T<1>(prod);
-        case 2: return left_multiply_by_T<2>(prod);
-        case 3: return left_multiply_by_T<3>(prod);
-        case 4: return left_multiply_by_T<4>(prod);
-        case 5: return left_multiply_by_T<5>(prod);
-        case 6: return left_multiply_by_T<6>(prod);
-        case 7: return left_multiply_by_T<7>(prod);
-        case 8: return left_multiply_by_T<8>(prod);
-        case 9: return left_multiply_by_T<9>(prod);
-        case 10: return left_multiply_by_T<10>(prod);
-        case 11: return left_multiply_by_T<11>(prod);
-        case 12: return left_multiply_by_T<12>(prod);
-        case 13: return left_multiply_by_T<13>(prod);
-        case 14: return left_multiply_by_T<14>(prod);
+        case 0: return left_multiply_by_T<0>(prod, canonical);
+        case 1: return left_multiply_by_T<1>(prod, canonical);
+        case 2: return left_multiply_by_T<2>(prod, canonical);
+        case 3: return left_multiply_by_T<3>(prod, canonical);
+        case 4: return left_multiply_by_T<4>(prod, canonical);
+        case 5: return left_multiply_by_T<5>(prod, canonical);
+        case 6: return left_multiply_by_T<6>(prod, canonical);
+        case 7: return left_multiply_by_T<7>(prod, canonical);
+        case 8: return left_multiply_by_T<8>(prod, canonical);
+        case 9: return left_multiply_by_T<9>(prod, canonical);
+        case 10: return left_multiply_by_T<10>(prod, canonical);
+        case 11: return left_multiply_by_T<11>(prod, canonical);
+        case 12: return left_multiply_by_T<12>(prod, canonical);
+        case 13: return left_multiply_by_T<13>(prod, canonical);
+        case 14: return left_multiply_by_T<14>(prod, canonical);
         default: throw std::invalid_argument("Invalid value for i");
     }
 }
@@ -144,7 +207,12 @@ void SO6::update_history(const unsigned char &p) {
  *      c. Copies the sorted column equivalence classes into the column permutation array.
  *      d. Checks if the current permutation is better than the previous one.
  *         - If it is, updates the Row and Col arrays with the current permutation and sets the sign convention.
+ *         - If it gives the same canonical form, the two differ by an automorphism of the matrix, a
+ *           signed permutation of its rows and columns that leaves it unchanged.
  *    - Continues to the next equivalence class permutation.
+ * 5. Records one T matrix per orbit of the 15 planes under the row and under the column parts of
+ *    the automorphisms found, in row_orbit_gates and col_orbit_gates. Left multiplying by T matrices
+ *    of one orbit gives children of one class.
  */
 void SO6::canonical_form() {
 
@@ -164,6 +232,7 @@ void SO6::canonical_form() {
 
     uint8_t row_perm[6];
     uint8_t col_perm[6];
+    plane_orbits row_orbits, col_orbits;
     
     do { 
         ptr = row_perm;
@@ -192,25 +261,37 @@ void SO6::canonical_form() {
                 ptr = std::copy(col_class.begin(), col_class.end(), ptr);
             }
 
-            if (is_better_permutation(row_perm, col_perm, sc)) {
+            const std::strong_ordering comparison = compare_permutation(row_perm, col_perm, sc);
+            if (comparison == Greater) {
                 std::copy(row_perm, row_perm + 6, Row);
                 std::copy(col_perm, col_perm + 6, Col);
                 sign_convention = sc;
+                row_orbits.reset();
+                col_orbits.reset();
+            } else if (comparison == Equal) {
+                row_orbits.join(Row, row_perm);
+                col_orbits.join(Col, col_perm);
             }
         }
     }  while (get_next_equivalence_class(row_ecs));
+    row_orbit_gates = row_orbits.representatives();
+    col_orbit_gates = col_orbits.representatives();
 }
 
-bool SO6::is_better_permutation(const uint8_t* row_perm, const uint8_t* col_perm, const int &sign_perm) {
+/**
+ * @brief Compares the canonical form so far with the one given by a permutation.
+ * @return Greater if the permutation's is better, Equal if it is the same.
+ */
+std::strong_ordering SO6::compare_permutation(const uint8_t* row_perm, const uint8_t* col_perm, const int &sign_perm) {
     for(int col = 0; col < 6; col++) {
         auto current = get_column(col, Row, Col);
         auto new_col = get_column(col, row_perm, col_perm);
         auto comparison = utils::lex_order(current, new_col, sign_convention, sign_perm);
 
         if (comparison == Equal) continue;
-        return comparison == Greater;
+        return comparison;
     }
-    return false;
+    return Equal;
 }
 
 /**
@@ -320,6 +401,131 @@ SO6 SO6::reconstruct_from_circuit_string(const std::string& input) {
     return ret;
 }
 
+/**
+ * @brief A circuit of the transpose, up to signed permutations, from a circuit of the matrix.
+ *
+ * The transpose of T_hn...T_h1 is T_h1^-1...T_hn^-1. Each inverse is a T matrix times the signed
+ * permutation T^-2, and moving a signed permutation to the right of a T matrix turns that into a
+ * T matrix of another plane or its inverse. Collecting the permutations on the right leaves
+ * T_g1...T_gn times a signed permutation P, the matrix of the circuit g_n, ..., g_1 times P.
+ *
+ * @param hist The packed history of the matrix.
+ * @param perm Receives P, which sends e_j to sign[j] e_perm[j].
+ * @param sign Receives the signs of P.
+ * @return The packed history of its transpose.
+ */
+static std::vector<unsigned char> transpose_history(const std::vector<unsigned char> &hist, int perm[6], int sign[6]) {
+    std::vector<int> gates;
+    for (const unsigned char byte : hist) {
+        gates.push_back((byte & 15) - 1);
+        if (byte > 15) gates.push_back((byte >> 4) - 1);
+    }
+
+    for (int j = 0; j < 6; ++j) {
+        perm[j] = j;
+        sign[j] = 1;
+    }
+    std::vector<int> out(gates.size());
+    for (size_t k = 0; k < gates.size(); ++k) {
+        const int r1 = T_PLANE[gates[k]][0], r2 = T_PLANE[gates[k]][1];
+        const int a = perm[r1], b = perm[r2], lo = std::min(a, b), hi = std::max(a, b);
+        int g = 0;
+        while (T_PLANE[g][0] != lo || T_PLANE[g][1] != hi) ++g;
+        out[gates.size() - 1 - k] = g;
+
+        // P T^-1 P^-1 has entry (lo, hi) equal to -sign[r1] sign[r2] if a < b and sign[r1] sign[r2] otherwise, T_g has +1 there
+        const bool inverse = (a < b ? -sign[r1] * sign[r2] : sign[r1] * sign[r2]) < 0;
+        if (!inverse) continue;
+        for (int j = 0; j < 6; ++j) {      // P becomes T_g^-2 P, which sends e_lo to e_hi and e_hi to -e_lo
+            if (perm[j] == lo) perm[j] = hi;
+            else if (perm[j] == hi) {
+                perm[j] = lo;
+                sign[j] = -sign[j];
+            }
+        }
+    }
+
+    std::vector<unsigned char> packed;
+    for (size_t k = 0; k < out.size(); ++k) {
+        if (k & 1) packed.back() |= (out[k] + 1) << 4;
+        else packed.push_back(out[k] + 1);
+    }
+    return packed;
+}
+
+/**
+ * @brief The transpose, which is the inverse of an orthogonal matrix.
+ *
+ * The history becomes a circuit of the transpose. Its columns are permuted so that the matrix is
+ * the circuit's own matrix, as for every matrix built by left multiplying T matrices, and the
+ * children of the transpose keep valid circuits as well.
+ *
+ * @param canonical Whether to bring the transpose into canonical form. Without it the transpose can
+ *                  be multiplied and left multiplied by T matrices, but not compared.
+ */
+SO6 SO6::transpose(const bool canonical) const {
+    SO6 t;
+    int perm[6], sign[6];
+    t.hist = transpose_history(hist, perm, sign);
+    // The transpose is the circuit's matrix times P, so column perm[j] of the circuit's matrix is sign[j] times row j here
+    for (int j = 0; j < 6; ++j) {
+        for (int row = 0; row < 6; ++row) {
+            t.arr[get_index(row, perm[j])] = arr[get_index(j, row)];
+            if (sign[j] < 0) t.arr[get_index(row, perm[j])] = -t.arr[get_index(row, perm[j])];
+        }
+        t.row_frequency[j] = col_frequency[j];
+        t.col_frequency[perm[j]] = row_frequency[j];
+    }
+    t.refresh_pattern();
+    if (canonical) t.canonical_form();
+    else t.row_orbit_gates = col_orbit_gates;     // The rows of the transpose are these columns, in order
+    return t;
+}
+
+/**
+ * @brief Bytes this matrix holds on the heap, the nodes of its frequency maps and its history.
+ *
+ * A map node is counted as three pointers, the color word and the entry, as libstdc++ lays it out,
+ * rounded up to the 16 bytes malloc hands out.
+ */
+size_t SO6::heap_bytes() const {
+    constexpr size_t node = (4 * sizeof(void *) + sizeof(std::pair<const Z2, int>) + 15) / 16 * 16;
+    size_t nodes = 0;
+    for (int k = 0; k < 6; ++k) nodes += row_frequency[k].size() + col_frequency[k].size();
+    return nodes * node + hist.capacity();
+}
+
+/**
+ * @brief The T matrices that would cancel one already in the history.
+ *
+ * T matrices of disjoint planes commute, and T_i T_i is a signed permutation. So if the history
+ * ends ...T_i X with every T matrix in X commuting with T_i, left multiplying by T_i gives a
+ * matrix in the class of the history with that T_i removed, two T matrices fewer.
+ *
+ * @return A mask with bit i set for each such T_i.
+ */
+uint16_t SO6::cancelling_gates() const {
+    static const auto commuting = [] {
+        std::array<uint16_t, 15> mask{};
+        for (int a = 0; a < 15; ++a)
+            for (int b = 0; b < 15; ++b) {
+                const bool disjoint = T_PLANE[a][0] != T_PLANE[b][0] && T_PLANE[a][0] != T_PLANE[b][1]
+                                   && T_PLANE[a][1] != T_PLANE[b][0] && T_PLANE[a][1] != T_PLANE[b][1];
+                if (disjoint) mask[a] |= 1 << b;
+            }
+        return mask;
+    }();
+    uint16_t cancelling = 0, open = 0x7FFF;     // open holds the T matrices that commute with every later one
+    for (auto byte = hist.rbegin(); byte != hist.rend() && open; ++byte) {
+        for (const int g : {*byte > 15 ? (*byte >> 4) - 1 : -1, (*byte & 15) - 1}) {
+            if (g < 0) continue;
+            if (open & (1 << g)) cancelling |= 1 << g;
+            open &= commuting[g];
+        }
+    }
+    return cancelling;
+}
+
 const std::strong_ordering SO6::operator<=>(const SO6 &other) const
 {
     for (int col = 0; col < 5; ++col)
@@ -336,28 +542,133 @@ const std::strong_ordering SO6::operator<=>(const SO6 &other) const
 }
 
 const z2_int SO6::getLDE() const {
-    return std::max_element(arr, arr + 36, [](const Z2& a, const Z2& b) {
-        return a.exponent < b.exponent;
-    })->exponent;
+    if (!pattern_valid) refresh_pattern();
+    return lde_memo;
+}
+
+/**
+ * @brief Pattern bits of one entry, given the LDE of its matrix.
+ *
+ * Entries at the LDE map to (1, sqrt2Part mod 2), nonzero entries one below it map to (0,1),
+ * and everything else maps to (0,0).
+ */
+static inline unsigned __int128 entry_pattern(const Z2 &z, const z2_int lde) {
+    if (z.intPart == 0 || z.exponent < lde - 1) return 0;
+    return z.exponent == lde ? (0b10 | (z.sqrt2Part & 1)) : 0b01;
+}
+
+/**
+ * @brief Recomputes the cached row LDEs, LDE and pattern from scratch.
+ */
+void SO6::refresh_pattern() const {
+    for (int row = 0; row < 6; ++row) {
+        row_lde[row] = arr[get_index(row, 0)].exponent;
+        for (int col = 1; col < 6; ++col) row_lde[row] = std::max(row_lde[row], arr[get_index(row, col)].exponent);
+    }
+    lde_memo = *std::max_element(row_lde, row_lde + 6);
+
+    unsigned __int128 bits = 0;
+    for (int col = 0; col < 6; ++col) for (int row = 0; row < 6; ++row)
+        bits |= entry_pattern(arr[get_index(row, col)], lde_memo) << pattern::cell_position(row, col);
+    pattern_memo = uint72_t::from_uint128(bits);
+    pattern_valid = true;
+}
+
+/**
+ * @brief Updates the cached LDE and pattern after rows row1 and row2 were rewritten.
+ *
+ * Untouched rows keep their pattern bits when the LDE is unchanged. When the LDE grows by one,
+ * their entries at the old LDE drop to (0,1) and those below it vanish, which is a masked shift
+ * of the integer bits into the sqrt(2) bits. Any other change falls back to a full rebuild.
+ *
+ * @param row1 First row modified.
+ * @param row2 Second row modified.
+ */
+void SO6::update_pattern(const int row1, const int row2) {
+    if (!pattern_valid) {
+        refresh_pattern();
+        return;
+    }
+
+    const z2_int old_lde = lde_memo;
+    for (const int row : {row1, row2}) {
+        row_lde[row] = arr[get_index(row, 0)].exponent;
+        for (int col = 1; col < 6; ++col) row_lde[row] = std::max(row_lde[row], arr[get_index(row, col)].exponent);
+    }
+    lde_memo = *std::max_element(row_lde, row_lde + 6);
+
+    const uint72_t untouched = pattern_memo & ~pattern::row_set_mask((1 << row1) | (1 << row2));
+    unsigned __int128 bits;
+    if (lde_memo == old_lde) {
+        bits = untouched.as_uint128();
+    } else if (lde_memo == old_lde + 1) {
+        bits = ((untouched & pattern::int_bits()) >> 1).as_uint128();
+    } else {
+        refresh_pattern();
+        return;
+    }
+
+    for (int col = 0; col < 6; ++col) {
+        bits |= entry_pattern(arr[get_index(row1, col)], lde_memo) << pattern::cell_position(row1, col);
+        bits |= entry_pattern(arr[get_index(row2, col)], lde_memo) << pattern::cell_position(row2, col);
+    }
+    pattern_memo = uint72_t::from_uint128(bits);
+}
+
+/**
+ * @brief Mixes the bits of a 64 bit word (splitmix64 finalizer).
+ */
+static inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Hash of the matrix that is invariant under its row and column permutations and signs.
+ *
+ * Entries are hashed up to sign and summed within each row, then the row hashes are summed, so
+ * every matrix that compares equal to this one has the same fingerprint.
+ */
+uint64_t SO6::fingerprint() const {
+    return fingerprint(false);
+}
+
+/**
+ * @brief The fingerprint of the transpose, without forming it.
+ */
+uint64_t SO6::transposed_fingerprint() const {
+    return fingerprint(true);
+}
+
+uint64_t SO6::fingerprint(const bool transposed) const {
+    uint64_t fp = 0;
+    for (int row = 0; row < 6; ++row) {
+        uint64_t row_hash = 0;
+        for (int col = 0; col < 6; ++col) {
+            Z2 z = transposed ? arr[get_index(col, row)] : arr[get_index(row, col)];
+            if (z.intPart < 0 || (z.intPart == 0 && z.sqrt2Part < 0)) z.negate();
+            if (z.intPart == 0 && z.sqrt2Part == 0) z.exponent = 0;
+            row_hash += mix64((uint8_t) z.intPart | ((uint8_t) z.sqrt2Part << 8) | ((uint8_t) z.exponent << 16));
+        }
+        fp += mix64(row_hash);
+    }
+    return fp;
+}
+
+/**
+ * @brief Returns the packed pattern bits of this matrix without building a pattern object.
+ */
+const uint72_t& SO6::pattern_bits() const {
+    if (!pattern_valid) refresh_pattern();
+    return pattern_memo;
 }
 
 pattern SO6::to_pattern() const
 {
     pattern ret = pattern();
-    ret.hist.reserve(hist.size());
     ret.hist = hist;
-
-    const int8_t lde = getLDE();
-    for(int col = 0; col < 6; ++col) for(int row = 0; row < 6; ++row)
-    {
-        const auto z = get_element(row,col);
-        if (z.exponent < lde - 1 || z.intPart == 0) continue;
-        if (z.exponent == lde) { 
-            ret.set(row, col, {1, z.sqrt2Part & 1});
-            continue;
-        }
-        ret.set(row,col,{0,1});
-    }
+    ret.pattern_data = pattern_bits();
     return ret;
 }
 
@@ -6,6 +6,7 @@
 #include <optional>
 #include <bitset>
 #include "Z2.hpp"
+#include "uint72_t.hpp"
 #include "pattern.hpp"
 
 class pattern;
@@ -17,10 +18,10 @@ class SO6{
         SO6(pattern &); //initializes matrix according to a pattern
 
         inline int get_index(const int &row, const int &col) const {return (col<<2) + (col<<1) + row;}
-        Z2* operator[](const int &col) {return arr + get_index(0,col);}  // Return the array element needed.
-        inline Z2& get_element(const int &row, const int &col) {return arr[get_index(row,col)];}  // Return the array element needed.
+        Z2* operator[](const int &col) {pattern_valid = false; return arr + get_index(0,col);}  // Return the array element needed.
+        inline Z2& get_element(const int &row, const int &col) {pattern_valid = false; return arr[get_index(row,col)];}  // Return the array element needed.
         inline const Z2 get_element(const int &row, const int &col) const {return arr[get_index(row,col)];}  // Return the array element needed.
-        Z2& get_lex_element(const int &row, const int &col) {return arr[get_index(Row[row],Col[col])];}  // Return the array element needed.
+        Z2& get_lex_element(const int &row, const int &col) {pattern_valid = false; return arr[get_index(Row[row],Col[col])];}  // Return the array element needed.
         const Z2 get_lex_element(const int &row, const int &col) const {return arr[get_index(Row[row],Col[col])];}  // Return the array element needed.
         const Z2* operator[](const int &col) const {return arr + get_index(0,col);}  // Return the array element needed. 
 
@@ -33,11 +34,16 @@ class SO6{
 
         SO6 left_multiply_by_circuit(std::vector<unsigned char> &);
         SO6 left_multiply_by_T_transpose(const int &);        
-        SO6 left_multiply_by_T(const int) const;
+        SO6 left_multiply_by_T(const int, const bool canonical = true) const;
 
         const z2_int getLDE() const;
         pattern to_pattern() const;
-        SO6 transpose();
+        const uint72_t& pattern_bits() const;
+        uint64_t fingerprint() const;
+        uint64_t transposed_fingerprint() const;
+        SO6 transpose(const bool canonical = true) const;
+        uint16_t cancelling_gates() const;
+        size_t heap_bytes() const;
         std::string name() const; 
         
         std::string circuit_string();
@@ -66,6 +72,7 @@ class SO6{
                 I.col_frequency[k][Z2(1,0,0)] = 1;
                 I.col_frequency[k][Z2(0,0,0)] = 5;
             }
+            I.refresh_pattern();
             return I;
         }
 
@@ -81,7 +88,7 @@ class SO6{
         bool submatrix_lex_less(std::vector<int> &, std::vector<int> &, int);
 
         template<int i> requires(i >= 0 && i < 15) 
-        static SO6 left_multiply_by_T(SO6 &S) {
+        static SO6 left_multiply_by_T(SO6 &S, const bool canonical = true) {
             int row1, row2;
             unsigned char p;
 
@@ -115,8 +122,10 @@ class SO6{
             #pragma unroll
             for (int col = 0; col < 6; col++)
             {
-                const Z2 row1_element = S.get_element(row1, col);
-                const Z2 row2_element = S.get_element(row2, col);
+                Z2 &row1_ref = S.arr[S.get_index(row1, col)];
+                Z2 &row2_ref = S.arr[S.get_index(row2, col)];
+                const Z2 row1_element = row1_ref;
+                const Z2 row2_element = row2_ref;
                 Z2 row1_element_abs = row1_element.abs();
                 Z2 row2_element_abs = row2_element.abs();
 
@@ -127,10 +136,10 @@ class SO6{
                 decrementFrequency(S.col_frequency[col], row2_element_abs);
 
                 // Update elements
-                S.get_element(row1, col) += row2_element;
-                S.get_element(row2, col) -= row1_element;
-                row1_element_abs = (S.get_element(row1, col).increaseDE()).abs();
-                row2_element_abs = (S.get_element(row2, col).increaseDE()).abs();
+                row1_ref += row2_element;
+                row2_ref -= row1_element;
+                row1_element_abs = (row1_ref.increaseDE()).abs();
+                row2_element_abs = (row2_ref.increaseDE()).abs();
 
                 // Update frequencies
                 S.row_frequency[row1][row1_element_abs]++;
@@ -139,7 +148,9 @@ class SO6{
                 S.col_frequency[col][row2_element_abs]++;
             }
 
-            S.canonical_form();
+            S.update_pattern(row1, row2);
+            if (canonical) S.canonical_form();
+            else S.row_orbit_gates = S.col_orbit_gates = 0x7FFF;
             S.update_history(p);
             return S;
         }
@@ -231,7 +242,7 @@ class SO6{
             }       
 
             Z2 arr[36];
-            bool is_better_permutation(const uint8_t*, const uint8_t*,const int & curr_sc);
+            std::strong_ordering compare_permutation(const uint8_t*, const uint8_t*,const int & curr_sc);
 
             std::pair<SO6::Iterator,SO6::Iterator> get_column(const int & col, const uint8_t* Row_ = nullptr, const uint8_t* Col_ = nullptr) const {
                 return std::pair<SO6::Iterator,SO6::Iterator>(Iterator(*this, (col << 2) + (col << 1), Row_, Col_), Iterator(*this, (col << 2) + (col << 1) + 6, Row_, Col_));
@@ -261,14 +272,28 @@ class SO6{
         inline uint8_t mask_of_column(const int& c);
         inline uint16_t set_mask_sign(const int& c, const uint8_t& sign);
         uint16_t sign_convention = 21845;
+        uint16_t row_orbit_gates = 0x7FFF;     // One T matrix per class of children, or all 15 if not canonical
+        uint16_t col_orbit_gates = 0x7FFF;     // The same for the transpose
 
     private:
+        friend class packed_layer;      // Rebuilds the frequency maps of unpacked matrices
+
         std::map<Z2,int> row_frequency[6];
         std::map<Z2,int> col_frequency[6];        
         
         uint16_t row_mask;
         uint16_t col_mask;
 
+        // LDE and pattern of arr, kept current by left_multiply_by_T and rebuilt lazily after any other write
+        mutable uint72_t pattern_memo;
+        mutable z2_int row_lde[6] = {0,0,0,0,0,0};
+        mutable z2_int lde_memo = 0;
+        mutable bool pattern_valid = false;
+
+        void refresh_pattern() const;
+        uint64_t fingerprint(const bool transposed) const;
+        void update_pattern(const int, const int);
+
         void sort_physical_array();
         void update_history(const unsigned char &); 
 
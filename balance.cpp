@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include "balance.hpp"
+
+tbb::enumerable_thread_specific<balance::thread_load> balance::loads;
+std::chrono::steady_clock::time_point balance::start_time;
+uint64_t balance::wall_ns = 0;
+
+/**
+ * @brief Estimates the relative cost of multiplying S by a generator.
+ *
+ * operator* only multiplies the nonzero entries of its right factor, so the cost grows with the
+ * number of nonzero entries of S on top of a fixed cost for copying the history and reading the
+ * product's pattern.
+ */
+uint32_t balance::cost(const SO6 &S) {
+    uint32_t nonzero = 0;
+    for (int col = 0; col < 6; ++col)
+        for (int row = 0; row < 6; ++row) nonzero += S[col][row].intPart != 0;
+    return FIXED_COST + nonzero;
+}
+
+/**
+ * @brief Cuts items into consecutive chunks of about equal total cost.
+ * @param items The matrices to split.
+ * @param count Number of chunks wanted. Fewer are returned if there are fewer items.
+ * @return The chunk boundaries: chunk c holds the items from bounds[c] up to bounds[c + 1].
+ */
+std::vector<size_t> balance::chunks(const packed_layer &items, const size_t count) {
+    std::vector<uint64_t> prefix(items.size() + 1, 0);
+    for (size_t i = 0; i < items.size(); ++i) prefix[i + 1] = prefix[i] + cost(items.matrix(i));
+
+    const size_t n = std::max<size_t>(1, std::min(count, items.size()));
+    std::vector<size_t> bounds = {0};
+    for (size_t c = 1; c < n; ++c) {
+        const uint64_t target = prefix.back() * c / n;
+        const size_t cut = std::lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin();
+        if (cut > bounds.back() && cut < items.size()) bounds.push_back(cut);
+    }
+    bounds.push_back(items.size());
+    return bounds;
+}
+
+/**
+ * @brief Starts timing a free multiply layer. Idle time is measured against the time between begin() and end().
+ */
+void balance::begin() {
+    start_time = std::chrono::steady_clock::now();
+}
+
+void balance::end() {
+    wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+/**
+ * @brief Prints the chunks, busy time and idle time of every thread over the free multiply phase.
+ * @param threads Number of threads the phase ran on. Threads that never ran a chunk were idle throughout.
+ */
+void balance::report(const int threads) {
+    if (wall_ns == 0) return;
+    const double wall = wall_ns / 1e9;
+    double idle_total = 0;
+    int t = 0;
+    for (const thread_load &load : loads) {
+        const double idle = std::max(0.0, wall - load.busy_ns / 1e9);
+        idle_total += idle;
+        std::cout << "[Balance] Thread " << t++ << ": " << load.chunks << " chunks, " << load.items << " matrices, busy "
+                  << std::fixed << std::setprecision(3) << load.busy_ns / 1e9 << "s, idle " << idle << "s ("
+                  << std::setprecision(1) << 100 * idle / wall << "%)" << std::defaultfloat << std::endl;
+    }
+    idle_total += std::max(0, threads - t) * wall;
+    std::cout << "[Balance] " << t << " of " << threads << " threads ran chunks, idle " << std::fixed << std::setprecision(1)
+              << 100 * idle_total / (wall * std::max(threads, t)) << "% of " << std::setprecision(3) << wall << "s" << std::defaultfloat << std::endl;
+}
+
+/**
+ * @brief Clears the recorded loads. Only for use while no thread is running chunks.
+ */
+void balance::reset() {
+    loads.clear();
+    wall_ns = 0;
+}
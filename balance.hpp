@@ -0,0 +1,83 @@
+#ifndef BALANCE_HPP
+#define BALANCE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+#include "SO6.hpp"
+#include "packed_layer.hpp"
+
+/**
+ * @file balance.hpp
+ * @brief Cost-aware work-stealing schedule for the free multiply phase.
+ *
+ * Products of the same generating set differ in cost, because operator* skips the zero entries of
+ * the stored matrix. The stored matrices are cut into chunks of equal estimated cost, many more
+ * chunks than threads, and the chunks run as TBB tasks, so threads that finish early steal the
+ * remaining chunks instead of idling until the slowest thread is done.
+ *
+ * Each thread's busy time is recorded, so report() can show how long every thread sat idle over
+ * the phase.
+ */
+class balance {
+public:
+    static constexpr size_t CHUNKS_PER_THREAD = 16;  // Enough chunks that the last ones are small
+    static constexpr uint32_t FIXED_COST = 12;       // Cost of a product independent of sparsity, in nonzero entries
+
+    struct thread_load {
+        uint64_t busy_ns = 0;
+        uint64_t chunks = 0;
+        uint64_t items = 0;
+    };
+
+    static uint32_t cost(const SO6 &S);
+    static std::vector<size_t> chunks(const packed_layer &items, const size_t count);
+
+    /**
+     * @brief Calls f on every chunk of items, in chunks of equal estimated cost spread over the current arena's threads.
+     * @param items The stored matrices.
+     * @param f Called with the first and one past the last index of each chunk. Must be safe to call from several threads at once.
+     */
+    template <typename F>
+    static void run_chunks(const packed_layer &items, F &&f) {
+        if (items.empty()) return;
+        const std::vector<size_t> bounds = chunks(items, CHUNKS_PER_THREAD * tbb::this_task_arena::max_concurrency());
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, bounds.size() - 1, 1), [&](const tbb::blocked_range<size_t> &r) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t c = r.begin(); c != r.end(); ++c) f(bounds[c], bounds[c + 1]);
+            thread_load &load = loads.local();
+            load.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            load.chunks += r.size();
+            load.items += bounds[r.end()] - bounds[r.begin()];
+        }, tbb::simple_partitioner());     // One task per chunk, so every chunk can be stolen
+    }
+
+    /**
+     * @brief Calls f on every item, chunked as in run_chunks().
+     * @param items The stored matrices.
+     * @param f Called with the index of each matrix. Must be safe to call from several threads at once.
+     */
+    template <typename F>
+    static void run(const packed_layer &items, F &&f) {
+        run_chunks(items, [&](const size_t begin, const size_t end) {
+            for (size_t i = begin; i < end; ++i) f(i);
+        });
+    }
+
+    static void begin();
+    static void end();
+    static void report(const int threads);
+    static void reset();
+
+private:
+    static tbb::enumerable_thread_specific<thread_load> loads;
+    static std::chrono::steady_clock::time_point start_time;
+    static uint64_t wall_ns;
+};
+
+#endif // BALANCE_HPP
@@ -0,0 +1,269 @@
+/**
+ * Micro-benchmarks for the hot paths of the synthesis code
+ * @file bench.cpp
+ *
+ * Run all benchmarks with ./bench.out, or name the ones to run, e.g. ./bench.out pattern
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "Globals.hpp"
+#include "bfs.hpp"
+#include "pattern.hpp"
+#include "tiling.hpp"
+#include "SO6.hpp"
+
+static std::chrono::high_resolution_clock::time_point now()
+{
+    return std::chrono::high_resolution_clock::now();
+}
+
+/**
+ * @brief Times a transform over a buffer of patterns and prints transforms per second.
+ * @param name Label of the transform.
+ * @param patterns Input patterns.
+ * @param reps Number of passes over the buffer.
+ * @param f Transform applied to each pattern, returning a pattern.
+ * @return Transforms per second.
+ */
+template <typename F>
+static double time_transform(const std::string &name, const std::vector<pattern> &patterns, const int reps, F f)
+{
+    uint64_t acc = 0;
+    auto start = now();
+    for (int rep = 0; rep < reps; ++rep) {
+        for (const pattern &p : patterns) {
+            pattern q = f(p);
+            acc += q.pattern_data.low_bits ^ q.pattern_data.high_bits;
+        }
+    }
+    std::chrono::duration<double> elapsed = now() - start;
+    asm volatile("" : : "g"(acc));     // Keeps the optimizer from discarding the results
+    double rate = (double) patterns.size() * reps / elapsed.count();
+    std::cout << "  " << name << ": " << rate / 1e6 << " M transforms/s" << std::endl;
+    return rate;
+}
+
+// Cell-by-cell implementations the bit-sliced transforms replaced
+static pattern legacy_mod_rows(const pattern &p, const int rows)
+{
+    pattern ret = p;
+    for (int r = 0; r < 6; ++r) {
+        if (!((rows >> r) & 1)) continue;
+        for (int c = 0; c < 6; ++c) {
+            uint8_t value = ret.get_val(r, c);
+            if (value < 2) continue;
+            ret.set(r, c, value ^ 1);
+        }
+    }
+    return ret;
+}
+
+static pattern legacy_permute_rows(const pattern &p, const int row[6])
+{
+    pattern ret;
+    for (int c = 0; c < 6; c++)
+        for (int r = 0; r < 6; r++)
+            ret.set(r, c, p.get(row[r], c));
+    return ret;
+}
+
+/**
+ * @brief Benchmarks row mods, full mods and row/column permutations of patterns.
+ */
+static void bench_pattern()
+{
+    std::cout << "[Bench] Pattern transforms" << std::endl;
+    std::mt19937_64 g(2024);
+    std::vector<pattern> patterns(1 << 16);
+    for (pattern &p : patterns) p.pattern_data = uint72_t(g(), static_cast<uint8_t>(g()));
+    const int reps = 64;
+    const int perm[6] = {3, 5, 0, 4, 1, 2};
+
+    double before, after;
+    before = time_transform("mod_rows (before)", patterns, reps, [](const pattern &p) { return legacy_mod_rows(p, 0x2D); });
+    after = time_transform("mod_rows (after) ", patterns, reps, [](const pattern &p) { pattern q = p; q.mod_rows(0x2D); return q; });
+    std::cout << "  ↪ speedup " << after / before << "x" << std::endl;
+
+    before = time_transform("pattern_mod (before)", patterns, reps, [](const pattern &p) { return legacy_mod_rows(p, 0x3F); });
+    after = time_transform("pattern_mod (after) ", patterns, reps, [](const pattern &p) { pattern q = p; return q.pattern_mod(); });
+    std::cout << "  ↪ speedup " << after / before << "x" << std::endl;
+
+    before = time_transform("permute_rows (before)", patterns, reps, [&](const pattern &p) { return legacy_permute_rows(p, perm); });
+    after = time_transform("permute_rows (after) ", patterns, reps, [&](const pattern &p) { return p.permute_rows(perm); });
+    std::cout << "  ↪ speedup " << after / before << "x" << std::endl;
+
+    time_transform("permute_cols", patterns, reps, [&](const pattern &p) { return p.permute_cols(perm); });
+}
+
+/**
+ * @brief Benchmarks scalar against batch pattern classification.
+ */
+static void bench_case_num()
+{
+    std::cout << "[Bench] Case numbers" << std::endl;
+    std::mt19937_64 g(2024);
+    std::vector<uint72_t> data(1 << 16);
+    for (uint72_t &d : data) d = uint72_t(g(), static_cast<uint8_t>(g()));
+    std::vector<uint8_t> cases(data.size());
+    const int reps = 64;
+
+    uint64_t acc = 0;
+    auto start = now();
+    for (int rep = 0; rep < reps; ++rep)
+        for (size_t i = 0; i < data.size(); ++i) acc += pattern(data[i].low_bits, data[i].high_bits).case_num();
+    std::chrono::duration<double> elapsed = now() - start;
+    double before = (double) data.size() * reps / elapsed.count();
+    std::cout << "  case_num (scalar): " << before / 1e6 << " M patterns/s" << std::endl;
+
+    start = now();
+    for (int rep = 0; rep < reps; ++rep) {
+        pattern::case_nums(data.data(), data.size(), cases.data());
+        acc += cases[rep];
+    }
+    elapsed = now() - start;
+    double after = (double) data.size() * reps / elapsed.count();
+    std::cout << "  case_nums (batch): " << after / 1e6 << " M patterns/s" << std::endl;
+    std::cout << "  ↪ speedup " << after / before << "x" << std::endl;
+    asm volatile("" : : "g"(acc));
+}
+
+/**
+ * @brief Times the breadth first search from the identity to T=7 on 1 thread up to every core.
+ */
+static void bench_bfs()
+{
+    std::cout << "[Bench] BFS scaling to T=7" << std::endl;
+    const int max_threads = std::thread::hardware_concurrency();
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    double serial = 0;
+    for (const int threads : thread_counts) {
+        Globals::limit_threads(threads);
+        packed_layer prior, current;
+        current.push_back(SO6::identity());
+        bfs::node_set next;
+        auto start = now();
+        for (int T = 0; T < 7; ++T) {
+            bfs::expand(current, prior, next, [](SO6 &) {}, [](size_t) {});
+            bfs::advance(prior, current, next);
+        }
+        std::chrono::duration<double> elapsed = now() - start;
+        if (threads == 1) serial = elapsed.count();
+        asm volatile("" : : "g"(current.size()));
+        std::cout << "  " << threads << " threads: " << elapsed.count() * 1000 << "ms, speedup " << serial / elapsed.count()
+                  << "x, efficiency " << 100 * serial / elapsed.count() / threads << "%" << std::endl;
+    }
+}
+
+/**
+ * @brief Counts last level cache misses of the calling thread, if the kernel allows it.
+ */
+class llc_counter {
+public:
+    llc_counter() {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~llc_counter() { if (fd >= 0) close(fd); }
+    bool available() const { return fd >= 0; }
+    void start() {
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    uint64_t stop() {
+        uint64_t misses = 0;
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) return 0;
+        return misses;
+    }
+
+private:
+    int fd;
+};
+
+/**
+ * @brief Times the free multiply products of a generating set larger than L2, nested against tiled.
+ *
+ * The generating set is the last BFS layer benchmarked by bench_bfs() grown by one more layer, and the
+ * stored matrices a slice of the layer before it.
+ */
+static void bench_tiling()
+{
+    packed_layer prior, current, stored;
+    current.push_back(SO6::identity());
+    bfs::node_set next;
+    for (int T = 0; T < 8; ++T) {
+        if (T == 7)
+            for (size_t i = 0; i < std::min<size_t>(64, current.size()); ++i) stored.push_back(current.matrix(i));
+        bfs::expand(current, prior, next, [](SO6 &) {}, [](size_t) {});
+        bfs::advance(prior, current, next);
+    }
+    const packed_layer &generators = current;
+    const tiling::cache_sizes caches = tiling::detect();
+    std::cout << "[Bench] Free multiply tiling, " << generators.size() << " generators (" << generators.bytes() / 1024
+              << "KiB) by " << stored.size() << " stored matrices, " << tiling::describe(caches) << std::endl;
+
+    llc_counter llc;
+    auto time_shape = [&](const std::string &name, const tiling::shape &shape) {
+        uint64_t acc = 0;
+        llc.start();
+        auto start = now();
+        tiling::for_each_tile(stored.size(), generators.size(), shape, [&](const size_t i, const size_t g_begin, const size_t g_end) {
+            const SO6 S = stored.matrix(i);
+            SO6 G;
+            for (size_t g = g_begin; g < g_end; ++g) {
+                generators.matrix(g, G);
+                acc ^= (G * S).pattern_bits().low_bits;
+            }
+        });
+        std::chrono::duration<double> elapsed = now() - start;
+        const uint64_t misses = llc.stop();
+        asm volatile("" : : "g"(acc));
+        const double products = (double) generators.size() * stored.size();
+        std::cout << "  " << name << " (" << shape.generators << "x" << shape.stored << "): " << products / elapsed.count() / 1e6
+                  << " M products/s, ";
+        if (llc.available()) std::cout << misses / products << " LLC misses/product" << std::endl;
+        else std::cout << "LLC misses unavailable" << std::endl;
+        return products / elapsed.count();
+    };
+
+    const double before = time_shape("nested", tiling::untiled(generators.size()));
+    const double after = time_shape("tiled ", tiling::tune(generators, stored));
+    std::cout << "  ↪ speedup " << after / before << "x" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> selected(argv + 1, argv + argc);
+    auto wants = [&](const std::string &name) {
+        return selected.empty() || std::find(selected.begin(), selected.end(), name) != selected.end();
+    };
+
+    if (wants("pattern")) bench_pattern();
+    if (wants("case_num")) bench_case_num();
+    if (wants("bfs")) bench_bfs();
+    if (wants("tiling")) bench_tiling();
+    return 0;
+}
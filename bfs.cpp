@@ -0,0 +1,95 @@
+#include <iostream>
+#include <tbb/parallel_reduce.h>
+#include "bfs.hpp"
+
+bool bfs::pruning = true;
+
+/**
+ * @brief Prints how many children pruning skipped, against those formed and then deduplicated.
+ */
+void bfs::report() {
+    const run_stats::totals t = run_stats::sum();
+    const uint64_t formed = t.dedup_hits + t.new_nodes, all = formed + t.pruned + t.same_orbit;
+    if (all == 0) return;
+    std::cout << "[Prune] " << all << " children: " << t.pruned << " skipped as cancelling (" << 100.0 * t.pruned / all << "%), "
+              << t.same_orbit << " as in a sibling's class (" << 100.0 * t.same_orbit / all << "%), " << t.dedup_hits
+              << " formed and deduplicated (" << 100.0 * t.dedup_hits / all << "%)" << std::endl;
+}
+
+/**
+ * @brief Rotates the layers for the next iteration.
+ *
+ * The matrices of next are packed into the new frontier in parallel, in the widths the widest of
+ * them needs, and each is freed as soon as it is packed. When next draws from a layer_arena its
+ * nodes are then released with one reset.
+ *
+ * @param prior Replaced by the current frontier.
+ * @param frontier Replaced by the contents of next, in sorted order.
+ * @param next Cleared.
+ */
+void bfs::advance(packed_layer &prior, packed_layer &frontier, node_set &next) {
+    std::vector<SO6 *> nodes;
+    nodes.reserve(next.size());
+    for (auto it = next.begin(); it != next.end(); ++it) nodes.push_back(&const_cast<SO6 &>(*it));   // The set is discarded below, so its order no longer matters
+
+    const packed_layer::layout format = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, nodes.size(), GRAIN), packed_layer::layout(),
+        [&](const tbb::blocked_range<size_t> &r, packed_layer::layout widest) {
+            for (size_t i = r.begin(); i != r.end(); ++i) widest = widest.widest(packed_layer::layout::of(*nodes[i]));
+            return widest;
+        },
+        [](const packed_layer::layout &a, const packed_layer::layout &b) { return a.widest(b); });
+
+    prior.swap(frontier);
+    frontier = packed_layer(format, nodes.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, nodes.size(), GRAIN), [&](const tbb::blocked_range<size_t> &r) {
+        for (size_t i = r.begin(); i != r.end(); ++i) {
+            frontier.set(i, *nodes[i]);
+            SO6 dead = std::move(*nodes[i]);    // Frees the maps and history on the workers
+        }
+    });
+
+    const layer_arena::allocator<SO6> alloc = next.get_allocator();
+    node_set(alloc).swap(next);     // Drops every node, the head included, before the arena reuses their memory
+    if (alloc.owner) alloc.owner->reset();
+}
+
+/**
+ * @brief One empty set per shard, each drawing its nodes from that shard's arena.
+ * @param arenas One arena per shard.
+ */
+bfs::next_layer bfs::next_layers(std::vector<std::unique_ptr<layer_arena>> &arenas) {
+    next_layer next;
+    next.reserve(arenas.size());
+    for (std::unique_ptr<layer_arena> &arena : arenas) next.emplace_back(layer_arena::allocator<SO6>(*arena));
+    return next;
+}
+
+/**
+ * @brief Rotates the layers of every shard, packing each shard's new frontier on its own node.
+ * @param prior Replaced by the current frontier.
+ * @param frontier Replaced by the contents of next, in sorted order.
+ * @param next Cleared.
+ */
+void bfs::advance(layer &prior, layer &frontier, next_layer &next) {
+    numa::for_each_shard([&](const size_t k) { advance(prior[k], frontier[k], next[k]); });
+}
+
+/**
+ * @brief Builds the first layer of a search, holding only the root in the shard that owns it.
+ * @param root The root of the search tree.
+ * @return The sharded layer.
+ */
+bfs::layer bfs::root_layer(const SO6 &root) {
+    layer l(numa::shards());
+    l[numa::shard_of(root)].push_back(root);
+    return l;
+}
+
+/**
+ * @brief Counts the matrices in a sharded layer.
+ */
+size_t bfs::size(const layer &l) {
+    size_t total = 0;
+    for (const packed_layer &shard : l) total += shard.size();
+    return total;
+}
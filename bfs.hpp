@@ -0,0 +1,219 @@
+#ifndef BFS_HPP
+#define BFS_HPP
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <tbb/blocked_range.h>
+#include <tbb/concurrent_set.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include "SO6.hpp"
+#include "coverage.hpp"
+#include "layer_arena.hpp"
+#include "numa.hpp"
+#include "packed_layer.hpp"
+#include "run_stats.hpp"
+#include "symmetry.hpp"
+
+/**
+ * @file bfs.hpp
+ * @brief Breadth first layer expansion on TBB's work-stealing scheduler.
+ *
+ * A layer is held as a sorted packed_layer, so tasks split the frontier by index range instead of
+ * walking a skiplist, and each node is rebuilt as a working matrix only while it is expanded. The
+ * previous layer is searched by bisection on its packed keys. Newly found matrices are collected
+ * in a concurrent set, which deduplicates them and whose iteration order is already sorted for
+ * the next layer, and are packed once the layer is complete. Tasks drain without work once coverage
+ * reports that every target has been found.
+ *
+ * In NUMA mode a layer is split into one sorted packed_layer per shard (see numa.hpp). Each shard
+ * expands its own frontier and buffers the children by destination shard, then each shard
+ * deduplicates the children routed to it against its own prior and next layers, so lookups and
+ * inserts stay on the shard's node.
+ *
+ * A child that left multiplies a node by a T matrix cancelling one in the node's history, through T
+ * matrices that commute with it (see SO6::cancelling_gates()), is in an earlier layer's class. Such
+ * children are skipped before they are formed unless pruning is turned off. So are the children of
+ * a symmetric node that an automorphism of the node maps to each other: the matrix is unchanged by
+ * a signed permutation P of its rows and one of its columns, so T_i S is in the class of
+ * P^-1 T_i P S, a T matrix of another plane or its inverse times S. Only one child per orbit of
+ * planes is formed. Reordering commuting T matrices alone is not pruned: a class is stored with one
+ * of its circuits up to signed permutations, which relabel the T matrices, so the circuit a
+ * reordering rule would keep need not be the one stored.
+ *
+ * Both forms count every child, skipped child, dedup hit and new node in run_stats. With transpose
+ * symmetry (see symmetry.hpp) a node also has the children of its transpose, and every child is
+ * replaced by the representative of its inverse pair before it is deduplicated.
+ */
+class bfs {
+public:
+    static constexpr int GENERATORS = 15;   // Number of T matrices
+    static constexpr size_t GRAIN = 16;     // Frontier nodes per task before TBB stops splitting
+    static constexpr size_t NESTED_FACTOR = 64; // Layers smaller than this many nodes per thread also split the children of a node
+    static constexpr size_t EXCHANGE_BLOCK = 4096; // Frontier nodes per shard expanded before their children are routed
+
+    static void prune(const bool on) { pruning = on; }
+    static bool pruning_enabled() { return pruning; }
+    static void report();
+
+    /**
+     * @brief The children of a node that are not formed, by child index.
+     *
+     * Those that cancel a T matrix of the node's history, and all but one of every orbit of
+     * children under the automorphisms canonical_form() found (see SO6::row_orbit_gates).
+     *
+     * @param S The node.
+     * @param transposed S.transpose(false), only read with transpose symmetry.
+     */
+    static uint32_t skipped(const SO6 &S, const SO6 &transposed) {
+        if (!pruning) return 0;
+        uint32_t cancel = S.cancelling_gates(), repeat = ~S.row_orbit_gates & 0x7FFF;
+        if (symmetry::enabled()) {
+            cancel |= (uint32_t) transposed.cancelling_gates() << GENERATORS;
+            repeat |= (uint32_t) (~transposed.row_orbit_gates & 0x7FFF) << GENERATORS;
+        }
+        run_stats::pruned(__builtin_popcount(cancel));
+        run_stats::same_orbit(__builtin_popcount(repeat & ~cancel));
+        return cancel | repeat;
+    }
+
+    using node_set = tbb::concurrent_set<SO6, std::less<SO6>, layer_arena::allocator<SO6>>;    // A layer being built
+    using layer = std::vector<packed_layer>;        // One sorted packed layer per shard
+    using next_layer = std::vector<node_set>;       // One set per shard
+
+    /**
+     * @brief Checks whether the children of each node should be expanded as their own tasks.
+     *
+     * Canonicalizing a child costs far more than scheduling a task, so when the layer is too small
+     * to keep every worker busy the 15 children of a node are spread over idle workers as well.
+     */
+    static bool nested(const size_t frontier_size) {
+        return frontier_size < NESTED_FACTOR * tbb::this_task_arena::max_concurrency();
+    }
+
+    /**
+     * @brief Expands one layer, inserting every child not in the prior layer into next.
+     * @param frontier The current layer, sorted.
+     * @param prior The previous layer, sorted.
+     * @param next Receives the children not in prior.
+     * @param on_new Called once for each child that was newly inserted into next.
+     * @param on_node Called with the index of each frontier node after its children are expanded.
+     */
+    template <typename NewF, typename NodeF>
+    static void expand(const packed_layer &frontier, const packed_layer &prior,
+                       node_set &next, NewF &&on_new, NodeF &&on_node) {
+        const bool split_children = nested(frontier.size());
+
+        const int children = GENERATORS * symmetry::orientations();
+        auto visit = [&](const SO6 &S, const SO6 &transposed, const int c) {
+            SO6 child = symmetry::child(S, transposed, c);
+            run_stats::children(1);
+            if (prior.contains(child) || !next.insert(child).second) {
+                run_stats::dedup_hit();
+                return;
+            }
+            run_stats::new_node();
+            on_new(child);
+        };
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, frontier.size(), GRAIN), [&](const tbb::blocked_range<size_t> &r) {
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                if (!coverage::worth_computing()) return;   // Everything has been found, drain the range
+                const SO6 S = frontier[i];
+                const SO6 transposed = symmetry::enabled() ? S.transpose(false) : SO6();
+                const uint32_t skip = skipped(S, transposed);
+                if (split_children) {
+                    tbb::parallel_for(0, children, [&](const int c) { if (!(skip >> c & 1)) visit(S, transposed, c); });
+                } else {
+                    for (int c = 0; c < children; ++c) if (!(skip >> c & 1)) visit(S, transposed, c);
+                }
+                on_node(i);
+            }
+        });
+    }
+
+    /**
+     * @brief Expands one sharded layer, routing every child to the shard that owns it.
+     * @param frontier The current layer, one sorted packed_layer per shard.
+     * @param prior The previous layer, one sorted packed_layer per shard.
+     * @param next Receives the children not in prior, one set per shard.
+     * @param on_new Called once for each child that was newly inserted into next.
+     * @param on_node Called with the index of each frontier node within its shard after its children are expanded.
+     */
+    template <typename NewF, typename NodeF>
+    static void expand(const layer &frontier, const layer &prior, next_layer &next, NewF &&on_new, NodeF &&on_node) {
+        if (!numa::sharded()) {
+            expand(frontier[0], prior[0], next[0], on_new, on_node);
+            return;
+        }
+
+        const size_t shards = numa::shards();
+        using buffers = std::vector<std::vector<SO6>>;
+        using outbox = tbb::enumerable_thread_specific<buffers>;   // Per thread buffers of children by destination shard
+        std::vector<outbox> outboxes;
+        outboxes.reserve(shards);
+        for (size_t k = 0; k < shards; ++k) outboxes.emplace_back(buffers(shards));
+
+        size_t longest = 0;
+        for (const packed_layer &shard : frontier) longest = std::max(longest, shard.size());
+        const bool split_children = nested(longest * shards);
+        const int children = GENERATORS * symmetry::orientations();
+
+        for (size_t begin = 0; begin < longest; begin += EXCHANGE_BLOCK) {
+            if (!coverage::worth_computing()) return;
+
+            numa::for_each_shard([&](const size_t k) {
+                const size_t end = std::min(frontier[k].size(), begin + EXCHANGE_BLOCK);
+                if (begin >= end) return;
+                tbb::parallel_for(tbb::blocked_range<size_t>(begin, end, GRAIN), [&](const tbb::blocked_range<size_t> &r) {
+                    for (size_t i = r.begin(); i != r.end(); ++i) {
+                        const SO6 S = frontier[k][i];
+                        const SO6 transposed = symmetry::enabled() ? S.transpose(false) : SO6();
+                        const uint32_t skip = skipped(S, transposed);
+                        auto route = [&](const int c) {
+                            if (skip >> c & 1) return;
+                            SO6 child = symmetry::child(S, transposed, c);
+                            outboxes[k].local()[numa::shard_of(child)].push_back(child);
+                        };
+                        if (split_children) {
+                            tbb::parallel_for(0, children, route);
+                        } else {
+                            for (int c = 0; c < children; ++c) route(c);
+                        }
+                        run_stats::children(children - __builtin_popcount(skip));
+                        on_node(i);
+                    }
+                });
+            });
+
+            numa::for_each_shard([&](const size_t j) {
+                std::vector<std::vector<SO6> *> inbox;
+                for (outbox &box : outboxes) for (buffers &routed : box) if (!routed[j].empty()) inbox.push_back(&routed[j]);
+                tbb::parallel_for(size_t(0), inbox.size(), [&](const size_t b) {
+                    for (SO6 &child : *inbox[b]) {
+                        if (prior[j].contains(child) || !next[j].insert(child).second) {
+                            run_stats::dedup_hit();
+                            continue;
+                        }
+                        run_stats::new_node();
+                        on_new(child);
+                    }
+                    inbox[b]->clear();
+                });
+            });
+        }
+    }
+
+    static void advance(packed_layer &prior, packed_layer &frontier, node_set &next);
+    static next_layer next_layers(std::vector<std::unique_ptr<layer_arena>> &arenas);
+    static void advance(layer &prior, layer &frontier, next_layer &next);
+    static layer root_layer(const SO6 &root);
+    static size_t size(const layer &l);
+
+private:
+    static bool pruning;
+};
+
+#endif // BFS_HPP
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "block_codec.hpp"
+
+static inline uint32_t load32(const unsigned char *p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+/**
+ * @brief Appends a length beyond what its token nibble holds, as bytes of 255 and a last byte below it.
+ */
+static inline void put_length(std::string &out, size_t extra) {
+    for (; extra >= 255; extra -= 255) out.push_back(static_cast<char>(255));
+    out.push_back(static_cast<char>(extra));
+}
+
+/**
+ * @brief Reads a length continued past its token nibble.
+ * @return false if the block ends inside it.
+ */
+static inline bool get_length(const unsigned char *src, const size_t n, size_t &ip, size_t &length) {
+    unsigned char b;
+    do {
+        if (ip >= n) return false;
+        b = src[ip++];
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+/**
+ * @brief Appends one sequence: its literals, then a match unless match_length is 0.
+ */
+static void put_sequence(std::string &out, const unsigned char *literals, const size_t count, const size_t offset, const size_t match_length) {
+    const size_t match_code = match_length ? match_length - block_codec::MIN_MATCH : 0;
+    out.push_back(static_cast<char>((std::min<size_t>(count, 15) << 4) | std::min<size_t>(match_code, 15)));
+    if (count >= 15) put_length(out, count - 15);
+    out.append(reinterpret_cast<const char *>(literals), count);
+    if (!match_length) return;
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (match_code >= 15) put_length(out, match_code - 15);
+}
+
+/**
+ * @brief Compresses a block.
+ * @param src The block.
+ * @param n Its length in bytes.
+ * @param out Receives the compressed block, replacing what it held.
+ */
+void block_codec::compress(const char *src, const size_t n, std::string &out) {
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    out.clear();
+    out.reserve(n + n / 255 + 16);
+    std::vector<uint32_t> last(size_t(1) << HASH_BITS, 0);     // Last position of each hashed sequence
+    size_t anchor = 0, i = 0;
+    while (i + MIN_MATCH <= n) {
+        const uint32_t sequence = load32(in + i);
+        const uint32_t h = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        const size_t candidate = last[h];
+        last[h] = i;
+        if (candidate >= i || i - candidate > MAX_OFFSET || load32(in + candidate) != sequence) {
+            ++i;
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (i + length < n && in[candidate + length] == in[i + length]) ++length;
+        put_sequence(out, in + anchor, i - anchor, i - candidate, length);
+        i += length;
+        anchor = i;
+    }
+    put_sequence(out, in + anchor, n - anchor, 0, 0);
+}
+
+/**
+ * @brief Decompresses a block, checking every length and offset against the block's bounds.
+ * @param src The compressed block.
+ * @param n Its length in bytes.
+ * @param raw_size Length of the block before compression.
+ * @param out Receives the block, replacing what it held.
+ * @return false if the compressed block is corrupt.
+ */
+bool block_codec::decompress(const char *src, const size_t n, const size_t raw_size, std::string &out) {
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    out.resize(raw_size);
+    char *dst = out.data();
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        const unsigned char token = in[ip++];
+        size_t count = token >> 4;
+        if (count == 15 && !get_length(in, n, ip, count)) return false;
+        if (count > n - ip || count > raw_size - op) return false;
+        std::memcpy(dst + op, in + ip, count);
+        ip += count;
+        op += count;
+        if (ip == n) break;     // The last sequence has no match
+
+        if (n - ip < 2) return false;
+        const size_t offset = in[ip] | (size_t(in[ip + 1]) << 8);
+        ip += 2;
+        size_t length = (token & 15) + MIN_MATCH;
+        if ((token & 15) == 15 && !get_length(in, n, ip, length)) return false;
+        if (offset == 0 || offset > op || length > raw_size - op) return false;
+        for (size_t k = 0; k < length; ++k, ++op) dst[op] = dst[op - offset];    // Byte by byte, since a match may overlap itself
+    }
+    return op == raw_size;
+}
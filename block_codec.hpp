@@ -0,0 +1,33 @@
+#ifndef BLOCK_CODEC_HPP
+#define BLOCK_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @file block_codec.hpp
+ * @brief A small LZ77 codec for the blocks of a compressed circuit file.
+ *
+ * Circuits recorded at one T count are products of a stored matrix and a generator, so their
+ * histories repeat the same runs of gates many times over. The codec replaces every repeat of at
+ * least MIN_MATCH bytes within the last 64 KB by its offset and length, finding repeats through a
+ * table of the last position of each hashed 4 byte sequence. It needs no dictionary or state
+ * beyond the block, so every block decodes on its own.
+ *
+ * A block is a run of sequences. Each starts with a token byte, whose high nibble is the number of
+ * literals and whose low nibble is the match length less MIN_MATCH, either continued in further
+ * bytes when it reads 15. The literals follow, and then the 2 byte offset of the match, low byte
+ * first, and the rest of its length. The last sequence of a block has literals only.
+ */
+class block_codec {
+public:
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr size_t MAX_OFFSET = 65535;
+    static constexpr int HASH_BITS = 13;
+
+    static void compress(const char *src, const size_t n, std::string &out);
+    static bool decompress(const char *src, const size_t n, const size_t raw_size, std::string &out);
+};
+
+#endif // BLOCK_CODEC_HPP
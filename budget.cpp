@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include "budget.hpp"
+
+uint64_t budget::limit_bytes = 0;
+std::vector<uint64_t> budget::sizes = {1};
+double budget::node_seconds = 0;
+double budget::product_seconds = 0;
+std::string budget::decision;
+
+/**
+ * @brief Reads a size such as 512M or 48G, in powers of 1024, or a plain number of bytes.
+ * @throws std::invalid_argument if spec is not a positive size.
+ */
+uint64_t budget::parse(const std::string &spec) {
+    size_t end = 0;
+    double value = 0;
+    try {
+        value = std::stod(spec, &end);
+    } catch (const std::exception &) {
+        throw std::invalid_argument("not a size: " + spec);
+    }
+    std::string unit = spec.substr(end);
+    if (!unit.empty() && (unit.back() == 'B' || unit.back() == 'b')) unit.pop_back();
+    int shift = 0;
+    if (unit.size() > 1) throw std::invalid_argument("unknown unit in " + spec);
+    if (unit.size() == 1) {
+        const size_t at = std::string("KMGT").find(std::toupper(unit[0]));
+        if (at == std::string::npos) throw std::invalid_argument("unknown unit in " + spec);
+        shift = 10 * (at + 1);
+    }
+    if (!(value > 0)) throw std::invalid_argument("size must be positive: " + spec);
+    return (uint64_t) std::ldexp(value, shift);
+}
+
+/**
+ * @brief The least stored depth, so that the generating sets are never deeper than the stored layer.
+ */
+int budget::lowest_depth(const int target) {
+    return (target + 1) / 2;
+}
+
+/**
+ * @brief Records a finished BFS layer and the wall time per node of the frontier it was expanded from.
+ */
+void budget::record_layer(const int T, const uint64_t matrices, const double seconds) {
+    if ((int) sizes.size() <= T) sizes.resize(T + 1, 0);
+    sizes[T] = matrices;
+    if (T > 0 && sizes[T - 1] > 0) node_seconds = seconds / sizes[T - 1];
+}
+
+/**
+ * @brief Times products of a sample of a layer by itself, as the free multiply phase forms them.
+ * @param layer The layer, whose matrices are as dense as the stored ones will be.
+ * @param threads Threads the free multiply phase divides the products between.
+ */
+void budget::time_products(const packed_layer &layer, const int threads) {
+    const size_t n = std::min(PRODUCT_SAMPLE, layer.size());
+    if (n == 0) return;
+    uint64_t acc = 0;
+    SO6 G;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        const SO6 S = layer.matrix(i);
+        for (size_t g = 0; g < n; ++g) {
+            layer.matrix(g, G);
+            acc += (G * S).pattern_bits().low_bits & 1;
+        }
+    }
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    asm volatile("" : : "g"(acc));     // Keeps the products from being optimized out
+    product_seconds = elapsed / (n * n) / std::max(1, threads);
+}
+
+/**
+ * @brief Prices every stored depth from the last recorded layer to the target and returns the cheapest that fits.
+ * @param sizes Matrices of each layer so far, the root first. Deeper layers grow by the last layer's growth.
+ * @param node_seconds Wall time to expand one frontier node.
+ * @param product_seconds Wall time of one free multiply product.
+ * @param next_peak Projected resident set while the next layer is built.
+ * @param limit The memory budget.
+ * @param target The target T count.
+ */
+budget::plan budget::best(const std::vector<uint64_t> &sizes, const double node_seconds, const double product_seconds,
+                          const uint64_t next_peak, const uint64_t limit, const int target) {
+    const int T = (int) sizes.size() - 1;
+    const double growth = T > 0 && sizes[T - 1] > 0 ? std::max(1.0, (double) sizes[T] / sizes[T - 1]) : 1.0;
+    auto size_of = [&](const int k) { return k <= T ? (double) sizes[k] : sizes[T] * std::pow(growth, k - T); };
+    auto free_seconds = [&](const int s) {
+        double generators = 1;      // The first free multiply layer multiplies by T₀ alone
+        for (int j = 1; j <= target - s - 1; ++j) generators += size_of(j);
+        return size_of(s) * generators * product_seconds;
+    };
+
+    plan p = {T, free_seconds(T), free_seconds(T), 0};
+    double bfs_seconds = 0;
+    for (int s = T + 1; s < target; ++s) {
+        const double peak = next_peak * std::pow(growth, s - T - 1);
+        if (peak > limit) break;   // Neither this layer nor any deeper one can be built
+        bfs_seconds += size_of(s - 1) * node_seconds;
+        const double total = bfs_seconds + free_seconds(s);
+        if (total < p.seconds) p = {s, total, p.stop_seconds, (uint64_t) peak};
+    }
+    return p;
+}
+
+static std::string megabytes(const uint64_t b) {
+    std::ostringstream out;
+    out.precision(1);
+    out << std::fixed << b / 1048576.0 << " MB";
+    return out.str();
+}
+
+/**
+ * @brief Decides after BFS layer T whether to build the next layer, and says why in describe().
+ * @param next_peak Projected resident set while the next layer is built.
+ * @return false to store layer T and switch to free multiplying.
+ */
+bool budget::keep_storing(const int T, const int target, const uint64_t next_peak) {
+    std::ostringstream out;
+    out << std::fixed;
+    out.precision(1);
+    if (T >= target - 1) {
+        decision.clear();
+        return false;
+    }
+    if (T < lowest_depth(target)) {
+        decision.clear();
+        if (next_peak > limit_bytes)
+            decision = "T=" + std::to_string(T + 1) + " projected at " + megabytes(next_peak) + ", over the budget of " + megabytes(limit_bytes)
+                       + ", but the stored depth is at least T=" + std::to_string(lowest_depth(target));
+        return true;
+    }
+    std::vector<uint64_t> known(sizes.begin(), sizes.begin() + T + 1);
+    const plan p = best(known, node_seconds, product_seconds, next_peak, limit_bytes, target);
+    if (p.depth > T) {
+        out << "Storing to T=" << p.depth << " projects " << p.seconds << "s against " << p.stop_seconds << "s stopping at T=" << T
+            << ", peaking at " << megabytes(p.peak) << " of " << megabytes(limit_bytes);
+    } else if (next_peak > limit_bytes) {
+        out << "Stopping at T=" << T << ", T=" << T + 1 << " is projected at " << megabytes(next_peak) << ", over the budget of " << megabytes(limit_bytes);
+    } else {
+        out << "Stopping at T=" << T << " projects " << p.stop_seconds << "s, less than any deeper stored layer";
+    }
+    decision = out.str();
+    return p.depth > T;
+}
+
+void budget::reset() {
+    limit_bytes = 0;
+    sizes = {1};
+    node_seconds = product_seconds = 0;
+    decision.clear();
+}
@@ -0,0 +1,57 @@
+#ifndef BUDGET_HPP
+#define BUDGET_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "packed_layer.hpp"
+
+/**
+ * @file budget.hpp
+ * @brief Choice of the stored depth from a memory budget while the BFS runs.
+ *
+ * Each BFS layer is several times larger than the one before, and so is the memory needed to build
+ * the next one, while the free multiply phase only holds the stored layer and the generating sets.
+ * A deeper stored layer makes the free multiply phase cheaper, since every later T count multiplies
+ * it by a smaller generating set, but costs another BFS layer and its memory.
+ *
+ * After each layer from half the target T count on, the run is priced both ways from what it has
+ * measured: the time per frontier node of the last layer, the time per product on a sample of the
+ * stored layer, and the growth between the last two layers, applied to every deeper layer. The BFS
+ * goes on while some deeper stored layer is cheaper in total and every layer up to it is projected
+ * to fit in the budget.
+ */
+class budget {
+public:
+    static constexpr size_t PRODUCT_SAMPLE = 64;    // Matrices each side of the timed products
+
+    struct plan {
+        int depth;          // Stored depth with the least total time
+        double seconds;     // Its projected time for the rest of the run
+        double stop_seconds;    // Projected time of stopping at the current layer
+        uint64_t peak;      // Projected resident set of the deepest layer it builds
+    };
+
+    static uint64_t parse(const std::string &spec);
+    static void configure(const uint64_t bytes) { limit_bytes = bytes; }
+    static bool active() { return limit_bytes > 0; }
+    static uint64_t limit() { return limit_bytes; }
+    static int lowest_depth(const int target);
+
+    static void record_layer(const int T, const uint64_t matrices, const double seconds);
+    static void time_products(const packed_layer &layer, const int threads);
+    static plan best(const std::vector<uint64_t> &sizes, const double node_seconds, const double product_seconds,
+                     const uint64_t next_peak, const uint64_t limit, const int target);
+    static bool keep_storing(const int T, const int target, const uint64_t next_peak);
+    static const std::string &describe() { return decision; }
+    static void reset();
+
+private:
+    static uint64_t limit_bytes;
+    static std::vector<uint64_t> sizes;     // Matrices of each layer, the root first
+    static double node_seconds;             // Wall time per frontier node of the last layer
+    static double product_seconds;          // Wall time per product of the free multiply phase
+    static std::string decision;
+};
+
+#endif // BUDGET_HPP
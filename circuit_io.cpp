@@ -0,0 +1,193 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "block_codec.hpp"
+#include "circuit_io.hpp"
+
+/**
+ * @brief The format of a circuit file, from its header. Files without one are text.
+ */
+result_writer::format circuit_io::format_of(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4] = {0, 0, 0, 0};
+    file.read(magic, 4);
+    if (file.gcount() != 4) return result_writer::TEXT;
+    if (std::memcmp(magic, result_writer::MAGIC, 4) == 0) return result_writer::BINARY;
+    if (std::memcmp(magic, result_writer::COMPRESSED_MAGIC, 4) == 0) return result_writer::COMPRESSED;
+    return result_writer::TEXT;
+}
+
+/**
+ * @brief Packs a line of space separated gate indices into a history, two gates per byte.
+ * @param line The line, as result_writer::append_text writes it. An empty line is the identity.
+ * @param hist Receives the history.
+ * @return false if the line holds anything but gates 0 to 14, or more than MAX_GATES of them.
+ */
+bool circuit_io::parse_line(const std::string &line, std::vector<unsigned char> &hist) {
+    hist.clear();
+    size_t n = 0;
+    int gate = -1;      // Gate being read, or -1 between gates
+    for (size_t i = 0; i <= line.size(); ++i) {
+        const char c = i < line.size() ? line[i] : ' ';
+        if (c >= '0' && c <= '9') {
+            gate = (gate < 0 ? 0 : gate * 10) + (c - '0');
+            if (gate > 14) return false;
+            continue;
+        }
+        if (c != ' ' && c != '\r' && c != '\t') return false;
+        if (gate < 0) continue;
+        if (n == MAX_GATES) return false;
+        if (n % 2 == 0) hist.push_back(gate + 1);
+        else hist.back() |= (gate + 1) << 4;
+        ++n;
+        gate = -1;
+    }
+    return true;
+}
+
+/**
+ * @brief Number of gates in a history. A product's history may hold unused nibbles between its factors.
+ */
+int circuit_io::gates(const std::vector<unsigned char> &hist) {
+    int n = 0;
+    for (const unsigned char byte : hist) n += ((byte & 15) != 0) + ((byte >> 4) != 0);
+    return n;
+}
+
+/**
+ * @brief Multiplies out the circuit of a history from the identity.
+ * @return The matrix of the circuit, in canonical form, with the history.
+ */
+SO6 circuit_io::replay(const std::vector<unsigned char> &hist) {
+    SO6 S = SO6::identity();
+    for (const unsigned char byte : hist) {
+        S = S.left_multiply_by_T((byte & 15) - 1);
+        if (byte >> 4) S = S.left_multiply_by_T((byte >> 4) - 1);
+    }
+    return S;
+}
+
+/**
+ * @brief Checks that every nibble of a binary record holds a gate, but the unused one of an odd count.
+ */
+static bool well_formed(const std::vector<unsigned char> &hist, const int count) {
+    for (size_t i = 0; i < hist.size(); ++i)
+        if ((hist[i] & 15) == 0 || ((hist[i] >> 4) == 0 && i + 1 < hist.size())) return false;
+    return circuit_io::gates(hist) == count;
+}
+
+/**
+ * @brief Hands over the binary records of a decoded block.
+ * @return false if the block ends inside a record.
+ */
+bool circuit_io::read_block(const std::string &block, const visitor &visit, load_result &result) {
+    std::vector<unsigned char> hist;
+    for (size_t pos = 0; pos < block.size(); ) {
+        const int count = static_cast<uint8_t>(block[pos++]);
+        if (pos + (count + 1) / 2 > block.size()) {
+            ++result.malformed;
+            return false;
+        }
+        hist.assign(block.begin() + pos, block.begin() + pos + (count + 1) / 2);
+        pos += hist.size();
+        if (!well_formed(hist, count)) {
+            ++result.malformed;
+            continue;
+        }
+        visit(hist);
+        ++result.read;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a text, binary or compressed circuit file a circuit at a time.
+ * @param path The file.
+ * @param visit Called with the history of every circuit, in file order.
+ * @return Counts of the circuits read and rejected. A binary file stops at the first truncated
+ *         record, and a compressed one skips a corrupt block and stops at a truncated one.
+ */
+circuit_io::load_result circuit_io::read(const std::string &path, const visitor &visit) {
+    load_result result;
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Failed to open circuit file: " << path << std::endl;
+        return result;
+    }
+    std::vector<unsigned char> hist;
+    result.format = format_of(path);
+    if (result.format == result_writer::TEXT) {
+        for (std::string line; std::getline(in, line); ) {
+            if (!parse_line(line, hist)) {
+                ++result.malformed;
+                continue;
+            }
+            visit(hist);
+            ++result.read;
+        }
+        return result;
+    }
+
+    in.seekg(result_writer::HEADER_SIZE);
+    if (result.format == result_writer::COMPRESSED) {
+        std::string payload, block;
+        unsigned char frame[result_writer::FRAME_SIZE];
+        while (in.read(reinterpret_cast<char *>(frame), result_writer::FRAME_SIZE)) {
+            uint32_t lengths[2] = {0, 0};
+            for (int i = 0; i < 8; ++i) lengths[i / 4] |= uint32_t(frame[i]) << (8 * (i % 4));
+            payload.resize(lengths[1]);
+            if (!in.read(payload.data(), payload.size())) {
+                ++result.malformed;
+                return result;
+            }
+            if (lengths[1] == lengths[0]) block.swap(payload);     // Stored as it is
+            else if (!block_codec::decompress(payload.data(), payload.size(), lengths[0], block)) {
+                ++result.malformed;
+                continue;
+            }
+            read_block(block, visit, result);
+        }
+        if (in.gcount() > 0) ++result.malformed;     // A partial frame
+        return result;
+    }
+
+    for (int count; (count = in.get()) != EOF; ) {
+        hist.resize((count + 1) / 2);
+        in.read(reinterpret_cast<char *>(hist.data()), hist.size());
+        if ((size_t) in.gcount() != hist.size()) {
+            ++result.malformed;
+            break;
+        }
+        if (!well_formed(hist, count)) {
+            ++result.malformed;
+            continue;
+        }
+        visit(hist);
+        ++result.read;
+    }
+    return result;
+}
+
+/**
+ * @brief Rewrites a circuit file in another format.
+ * @param in_path The file to convert, in any format.
+ * @param out_path The converted file, truncated if it exists.
+ * @param to The format to write.
+ * @return Counts of the circuits written and of the lines or records skipped.
+ */
+circuit_io::load_result circuit_io::convert(const std::string &in_path, const std::string &out_path, const result_writer::format to) {
+    if (!std::ifstream(in_path).is_open()) {
+        std::cerr << "Failed to open circuit file: " << in_path << std::endl;
+        return {};
+    }
+    result_writer out(out_path, to);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file: " << out_path << std::endl;
+        return {};
+    }
+    SO6 carrier;    // Records only need the history, so the matrix is never formed
+    return read(in_path, [&](const std::vector<unsigned char> &hist) {
+        carrier.hist = hist;
+        out.record(carrier);
+    });
+}
@@ -0,0 +1,44 @@
+#ifndef CIRCUIT_IO_HPP
+#define CIRCUIT_IO_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "SO6.hpp"
+#include "result_writer.hpp"
+
+/**
+ * @file circuit_io.hpp
+ * @brief Reading and converting the circuit files that result_writer writes to ./data/<t>.dat.
+ *
+ * Each of result_writer's formats is read, told apart by the header. Either way a circuit arrives
+ * as its history, two gates per byte exactly as SO6::hist stores them, so binary records are handed
+ * over as they are and text lines are packed digit by digit without a string stream. A compressed
+ * file is read a block at a time, so only one decoded block is ever held.
+ */
+class circuit_io {
+public:
+    static constexpr size_t MAX_GATES = 255;    // Largest gate count a binary record can hold
+
+    /**
+     * @brief Read statistics for a circuit file.
+     */
+    struct load_result {
+        uint64_t read = 0;          // Circuits handed to the caller
+        uint64_t malformed = 0;     // Lines or records rejected
+        result_writer::format format = result_writer::TEXT;
+    };
+
+    using visitor = std::function<void(const std::vector<unsigned char> &hist)>;
+
+    static result_writer::format format_of(const std::string &path);
+    static bool parse_line(const std::string &line, std::vector<unsigned char> &hist);
+    static int gates(const std::vector<unsigned char> &hist);
+    static SO6 replay(const std::vector<unsigned char> &hist);
+    static bool read_block(const std::string &block, const visitor &visit, load_result &result);
+
+    static load_result read(const std::string &path, const visitor &visit);
+    static load_result convert(const std::string &in_path, const std::string &out_path, const result_writer::format to);
+};
+
+#endif // CIRCUIT_IO_HPP
@@ -0,0 +1,148 @@
+/**
+ * Load test client for the synthesis server
+ * @file client.cpp
+ *
+ * Sends the targets of a query file to a server started with --serve <socket> in batches, over
+ * several connections at once, and prints the throughput and the round trip latency of the
+ * batches. Run as ./client.out <socket> <query file> [batch size] [repeats] [connections]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * @brief Connects to the server's socket.
+ * @return The connected descriptor, or -1.
+ */
+static int connect_to(const std::string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) return -1;
+    address.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), address.sun_path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *) &address, sizeof(address)) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_all(const int fd, const std::string &data) {
+    for (size_t sent = 0; sent < data.size(); ) {
+        const ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads reply lines until one starts with the given word.
+ * @param fd The connection.
+ * @param pending Bytes read past the previous reply.
+ * @param last Word that starts the last line of the reply.
+ * @param lines Receives the lines of the reply.
+ * @return false if the connection closed first.
+ */
+static bool read_reply(const int fd, std::string &pending, const std::string &last, std::vector<std::string> &lines) {
+    char buffer[1 << 16];
+    while (true) {
+        for (size_t newline; (newline = pending.find('\n')) != std::string::npos; ) {
+            lines.push_back(pending.substr(0, newline));
+            pending.erase(0, newline + 1);
+            if (lines.back().rfind(last, 0) == 0) return true;
+        }
+        const ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) return false;
+        pending.append(buffer, n);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <socket> <query file> [batch size] [repeats] [connections]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string socket_path = argv[1];
+    const size_t batch_size = argc > 3 ? std::max(1, std::stoi(argv[3])) : 16;
+    const int repeats = argc > 4 ? std::max(1, std::stoi(argv[4])) : 1;
+    const int connections = argc > 5 ? std::max(1, std::stoi(argv[5])) : 1;
+
+    std::vector<std::string> targets;
+    std::ifstream file(argv[2]);
+    for (std::string line; getline(file, line); )
+        if (!line.empty() && line[0] != '#') targets.push_back(line);
+    if (targets.empty()) {
+        std::cerr << "No targets in " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::vector<double>> batch_ms(connections);
+    std::vector<size_t> answered(connections, 0), failed(connections, 0);
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < connections; ++c) {
+        clients.emplace_back([&, c] {
+            const int fd = connect_to(socket_path);
+            if (fd < 0) {
+                std::cerr << "[Client] Could not connect to " << socket_path << std::endl;
+                return;
+            }
+            std::string pending;
+            for (int r = 0; r < repeats; ++r) {
+                for (size_t begin = 0; begin < targets.size(); begin += batch_size) {
+                    std::string request;
+                    const size_t end = std::min(targets.size(), begin + batch_size);
+                    for (size_t i = begin; i < end; ++i) request += targets[i] + "\n";
+                    const auto sent = std::chrono::steady_clock::now();
+                    std::vector<std::string> lines;
+                    if (!send_all(fd, request + "\n") || !read_reply(fd, pending, "END", lines)) {
+                        close(fd);
+                        return;
+                    }
+                    batch_ms[c].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+                    for (const std::string &line : lines) {
+                        answered[c] += line.rfind("OK", 0) == 0;
+                        failed[c] += line.rfind("NONE", 0) == 0 || line.rfind("ERR", 0) == 0;
+                    }
+                }
+            }
+            send_all(fd, "QUIT\n");
+            close(fd);
+        });
+    }
+    for (std::thread &t : clients) t.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    size_t ok = 0, bad = 0;
+    for (int c = 0; c < connections; ++c) {
+        all.insert(all.end(), batch_ms[c].begin(), batch_ms[c].end());
+        ok += answered[c];
+        bad += failed[c];
+    }
+    if (all.empty()) return EXIT_FAILURE;
+    std::sort(all.begin(), all.end());
+    std::cout << "[Client] " << ok << " answered, " << bad << " not found or invalid in " << seconds << "s ("
+              << (ok + bad) / seconds << " queries/s)" << std::endl;
+    std::cout << "[Client] Batch of " << batch_size << " round trip: p50 " << all[all.size() / 2] << "ms, p99 "
+              << all[std::min(all.size() - 1, all.size() * 99 / 100)] << "ms, max " << all.back() << "ms" << std::endl;
+
+    const int fd = connect_to(socket_path);
+    std::string pending;
+    std::vector<std::string> lines;
+    if (fd >= 0 && send_all(fd, "STATS\n") && read_reply(fd, pending, "STATS", lines)) std::cout << "[Client] Server " << lines.back() << std::endl;
+    if (fd >= 0) {
+        send_all(fd, "QUIT\n");
+        close(fd);
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <fstream>
+#include <iostream>
+#include "coverage.hpp"
+
+uint16_t coverage::target_mask = 0;
+std::atomic<uint16_t> coverage::remaining_mask{0};
+std::chrono::high_resolution_clock::time_point coverage::start_time = std::chrono::high_resolution_clock::now();
+std::chrono::duration<double> coverage::time_to_full = std::chrono::duration<double>::zero();
+uint8_t coverage::found_at[9] = {0};
+
+/**
+ * @brief Starts coverage tracking for the loaded target patterns.
+ * @param targets The patterns to be found, typically pattern_set after reading the pattern file.
+ */
+void coverage::begin(const tbb::concurrent_set<pattern> &targets) {
+    target_mask = 0;
+    for (const pattern &p : targets) target_mask |= (1 << p.case_num());
+    target_mask &= ALL_CASES;
+    remaining_mask.store(target_mask);
+    std::fill(found_at, found_at + 9, 0);
+    start_time = std::chrono::high_resolution_clock::now();
+}
+
+/**
+ * @brief Marks the case of a pattern as found. The thread that completes coverage stamps the time.
+ * @param p The pattern that was found.
+ * @param T The T count at which it was found.
+ * @return true if this call claimed the case, false if another thread found it first.
+ */
+bool coverage::found(const pattern &p, const int T) {
+    const uint16_t bit = 1 << p.case_num();
+    const uint16_t prior = remaining_mask.fetch_and(~bit);
+    if (!(prior & bit)) return false;
+    found_at[p.case_num()] = T;
+    if (prior == bit) time_to_full = std::chrono::high_resolution_clock::now() - start_time;
+    return true;
+}
+
+/**
+ * @brief Reports which cases were found at which T count, and the time to full coverage.
+ */
+void coverage::report() {
+    if (!has_targets()) return;
+    std::cout << "[Coverage] Found cases:";
+    for (int c = 1; c < 9; ++c) {
+        if (!((target_mask >> c) & 1)) continue;
+        if (found_at[c]) std::cout << " " << c << "@T=" << (int) found_at[c];
+        else std::cout << " " << c << "@-";
+    }
+    std::cout << "\n";
+    if (complete() && time_to_full == std::chrono::duration<double>::zero()) {
+        std::cout << "[Coverage] Every target case was found." << std::endl;     // Merged from other runs, so there is no time to report
+    } else if (complete()) {
+        std::cout << "[Coverage] Time to full coverage: " << time_to_full.count() << "s" << std::endl;
+    } else {
+        std::cout << "[Coverage] Incomplete: " << __builtin_popcount(remaining()) << " of "
+                  << __builtin_popcount(target_mask) << " target cases remain." << std::endl;
+    }
+}
+
+/**
+ * @brief Writes the found cases, one "case T" line each, so another run can merge them.
+ * @param path Path of the coverage file.
+ */
+void coverage::save(const std::string &path) {
+    std::ofstream out(path, std::ios::trunc);
+    for (int c = 1; c < 9; ++c) if (found_at[c]) out << c << " " << (int) found_at[c] << "\n";
+}
+
+/**
+ * @brief Merges a coverage file written by save(), keeping the lowest T count found for each case.
+ * @param path Path of the coverage file.
+ * @return false if the file could not be opened.
+ */
+bool coverage::merge(const std::string &path) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+    int c, T;
+    while (in >> c >> T) {
+        if (c < 1 || c > 8) continue;
+        if (!found_at[c] || T < found_at[c]) found_at[c] = T;
+        remaining_mask.fetch_and(~(1 << c));
+    }
+    return true;
+}
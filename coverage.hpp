@@ -0,0 +1,50 @@
+#ifndef COVERAGE_HPP
+#define COVERAGE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <tbb/concurrent_set.h>
+#include "pattern.hpp"
+
+/**
+ * @file coverage.hpp
+ * @brief Tracks which target pattern cases remain so every phase can stop once all are found.
+ *
+ * pattern_set orders patterns by case number, so the targets are tracked as a bitmask over the
+ * case numbers 1 through 8. Phases poll worth_computing() between generating sets, layers and
+ * to_compute slices and skip the rest of their work once every target has been found.
+ */
+class coverage {
+public:
+    static constexpr uint16_t ALL_CASES = 0x1FE;   // Case numbers 1-8; case 0 is the identity class and never a target
+
+    static void begin(const tbb::concurrent_set<pattern> &targets);
+    static bool found(const pattern &p, const int T);
+
+    static bool has_targets() { return target_mask != 0; }
+    static uint16_t remaining() { return remaining_mask.load(std::memory_order_relaxed); }
+    static bool complete() { return has_targets() && remaining() == 0; }
+    static bool wants(const uint8_t case_num) { return (remaining() >> case_num) & 1; }
+
+    /**
+     * @brief Checks whether a generating set or to_compute slice is still worth computing.
+     *
+     * Every non-identity case is reachable from every slice at the depths we store, so a slice is
+     * exhausted exactly when no target case remains. With no pattern file nothing is exhausted.
+     */
+    static bool worth_computing() { return !complete(); }
+
+    static void report();
+    static void save(const std::string &path);
+    static bool merge(const std::string &path);
+
+private:
+    static uint16_t target_mask;
+    static std::atomic<uint16_t> remaining_mask;
+    static std::chrono::high_resolution_clock::time_point start_time;
+    static std::chrono::duration<double> time_to_full;
+    static uint8_t found_at[9];
+};
+
+#endif // COVERAGE_HPP
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <unordered_map>
+#include "join.hpp"
+#include "pattern.hpp"
+
+join::counters join::stats;
+
+/**
+ * @brief Gathers the integer bits of a pattern, entry (row, col) at bit 6*col + row.
+ */
+uint64_t join::int_bits(const uint72_t &pattern_bits) {
+    const unsigned __int128 bits = pattern_bits.as_uint128();
+    uint64_t out = 0;
+    for (int col = 0; col < 6; ++col)
+        for (int row = 0; row < 6; ++row)
+            out |= (uint64_t) ((bits >> (pattern::cell_position(row, col) + 1)) & 1) << (6 * col + row);
+    return out;
+}
+
+/**
+ * @brief Product of two matrices of integer bits over GF(2).
+ * @param left Integer bits of the left factor.
+ * @param right Integer bits of the right factor.
+ */
+uint64_t join::int_product(const uint64_t left, const uint64_t right) {
+    uint64_t out = 0;
+    for (int col = 0; col < 6; ++col) {
+        uint64_t column = 0;
+        for (int k = 0; k < 6; ++k)
+            if ((right >> (6 * col + k)) & 1) column ^= (left >> (6 * k)) & 0x3F;
+        out |= column << (6 * col);
+    }
+    return out;
+}
+
+/**
+ * @brief Case number of any pattern with these integer bits. The sqrt(2) bits never change the case.
+ */
+uint8_t join::int_case(const uint64_t bits) {
+    unsigned __int128 data = 0;
+    for (int col = 0; col < 6; ++col)
+        for (int row = 0; row < 6; ++row)
+            data |= (unsigned __int128) ((bits >> (6 * col + row)) & 1) << (pattern::cell_position(row, col) + 1);
+    const uint72_t packed = uint72_t::from_uint128(data);
+    return pattern(packed.low_bits, packed.high_bits).case_num();
+}
+
+/**
+ * @brief The entries of S scaled by sqrt(2)^LDE, mod 16.
+ */
+join::residue join::residues(const SO6 &S) {
+    residue out;
+    const int lde = S.getLDE();
+    for (int col = 0; col < 6; ++col) {
+        for (int row = 0; row < 6; ++row) {
+            const Z2 z = S.get_element(row, col);
+            uint8_t a = z.intPart & 15, b = z.sqrt2Part & 15;
+            if (z.intPart == 0) a = b = 0;
+            for (int e = z.exponent; e < lde && (a | b); ++e) {     // Times sqrt(2): a + b*sqrt(2) -> 2b + a*sqrt(2)
+                const uint8_t doubled = (2 * b) & 15;
+                b = a;
+                a = doubled;
+            }
+            out[6 * col + row] = a | (b << 4);
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief sqrt(2)-adic valuation of a + b*sqrt(2) mod 16, capped at 8.
+ */
+static inline int valuation(const uint8_t a, const uint8_t b) {
+    const int va = a ? 2 * __builtin_ctz(a) : 8;
+    const int vb = b ? 2 * __builtin_ctz(b) + 1 : 9;
+    return std::min(8, std::min(va, vb));
+}
+
+/**
+ * @brief Pattern of the product of two matrices from their residues.
+ * @param left Residues of the left factor.
+ * @param right Residues of the right factor.
+ * @param out Receives the pattern of left * right.
+ * @return false if the LDE of the product drops by more than MAX_DROP, which leaves its pattern undetermined.
+ */
+bool join::product_pattern(const residue &left, const residue &right, uint72_t &out) {
+    uint8_t a[36], b[36];
+    int drop = 8;
+    for (int col = 0; col < 6; ++col) {
+        for (int row = 0; row < 6; ++row) {
+            unsigned sum_a = 0, sum_b = 0;
+            for (int k = 0; k < 6; ++k) {
+                const uint8_t l = left[6 * k + row], r = right[6 * col + k];
+                const unsigned la = l & 15, lb = l >> 4, ra = r & 15, rb = r >> 4;
+                sum_a += la * ra + 2 * lb * rb;
+                sum_b += la * rb + lb * ra;
+            }
+            a[6 * col + row] = sum_a & 15;
+            b[6 * col + row] = sum_b & 15;
+            drop = std::min(drop, valuation(a[6 * col + row], b[6 * col + row]));
+        }
+    }
+    if (drop > MAX_DROP) return false;
+
+    // Divided by sqrt(2)^drop, entries of valuation drop are odd and those one above it are sqrt(2) times odd
+    const int half = drop / 2;
+    unsigned __int128 bits = 0;
+    for (int col = 0; col < 6; ++col) {
+        for (int row = 0; row < 6; ++row) {
+            const int i = 6 * col + row;
+            const int v = valuation(a[i], b[i]);
+            unsigned __int128 entry = 0;
+            if (v == drop) entry = 0b10 | ((drop & 1) ? (a[i] >> (half + 1)) & 1 : (b[i] >> half) & 1);
+            else if (v == drop + 1) entry = 0b01;
+            bits |= entry << pattern::cell_position(row, col);
+        }
+    }
+    out = uint72_t::from_uint128(bits);
+    return true;
+}
+
+/**
+ * @brief Buckets matrices by their integer bits and computes their residues.
+ */
+join::index join::build(const packed_layer &matrices) {
+    index out;
+    out.residues.resize(matrices.size());
+    std::unordered_map<uint64_t, size_t> bucket_of;
+    for (size_t i = 0; i < matrices.size(); ++i) {
+        const SO6 S = matrices.matrix(i);
+        const uint64_t key = int_bits(S.pattern_bits());
+        auto [it, inserted] = bucket_of.try_emplace(key, out.buckets.size());
+        if (inserted) {
+            out.keys.push_back(key);
+            out.buckets.emplace_back();
+        }
+        out.buckets[it->second].push_back(i);
+        out.residues[i] = residues(S);
+    }
+    return out;
+}
+
+/**
+ * @brief Prints how many products the join skipped, classified from residues and multiplied.
+ */
+void join::report() {
+    const uint64_t pairs = stats.pairs;
+    if (pairs == 0) return;
+    std::cout << "[Join] " << pairs << " products: " << stats.skipped << " skipped by bucket, " << stats.residue_products
+              << " classified from residues, " << stats.multiplied << " multiplied (" << 100.0 * stats.multiplied / pairs
+              << "%)" << std::endl;
+}
+
+void join::reset() {
+    stats.pairs = stats.skipped = stats.residue_products = stats.multiplied = 0;
+}
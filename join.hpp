@@ -0,0 +1,118 @@
+#ifndef JOIN_HPP
+#define JOIN_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "SO6.hpp"
+#include "packed_layer.hpp"
+#include "uint72_t.hpp"
+
+/**
+ * @file join.hpp
+ * @brief Targeted free multiply: a hash join of the stored matrices and a generating set on residues.
+ *
+ * Scaling a matrix by sqrt(2)^LDE makes its entries elements of Z[sqrt(2)], and its pattern is
+ * exactly that scaled matrix mod 2. Reduction mod 2 commutes with products, so whenever the scaled
+ * product G*S has an odd entry (its LDE is the sum of the factors' LDEs) its pattern is the product
+ * of the factors' patterns over Z[sqrt(2)]/2, and its integer bits, which alone fix its case, are
+ * the product of the factors' integer bits over GF(2).
+ *
+ * Both sides are bucketed by their integer bits. A pair of buckets whose integer product is nonzero
+ * has one case for every pair of matrices in it, so it is skipped outright unless that case is still
+ * a target. Pairs whose integer product vanishes have products whose LDE drops. For these, the
+ * scaled entries are kept mod 16, which fixes the pattern of every product whose LDE drops by at
+ * most 6, and only products whose case is a target, or is not fixed, are actually multiplied.
+ */
+class join {
+public:
+    static constexpr int MAX_DROP = 6;      // Largest LDE drop whose pattern the residues mod 16 determine
+
+    using residue = std::array<uint8_t, 36>;    // Scaled entry (row, col) at 6*col + row, a | b << 4 for a + b*sqrt(2) mod 16
+
+    struct index {
+        std::vector<uint64_t> keys;                     // Integer bits of each bucket
+        std::vector<std::vector<uint32_t>> buckets;     // Positions of the matrices with those bits
+        std::vector<residue> residues;                  // Residues of every matrix, by position
+    };
+
+    struct counters {
+        std::atomic<uint64_t> pairs{0};             // Products a brute force multiply would form
+        std::atomic<uint64_t> skipped{0};           // Products skipped with their whole bucket pair
+        std::atomic<uint64_t> residue_products{0};  // Products whose pattern came from residues
+        std::atomic<uint64_t> multiplied{0};        // Products actually formed
+    };
+
+    static uint64_t int_bits(const uint72_t &pattern_bits);
+    static uint64_t int_product(const uint64_t left, const uint64_t right);
+    static uint8_t int_case(const uint64_t bits);
+    static residue residues(const SO6 &S);
+    static bool product_pattern(const residue &left, const residue &right, uint72_t &out);
+    static index build(const packed_layer &matrices);
+
+    /**
+     * @brief Whether a free multiply layer should be a join rather than a brute force multiply.
+     * @param remaining Bitmask of the target cases not yet found, as coverage::remaining() returns it.
+     * @param threshold Most target cases that may remain for the join, or 0 to never join.
+     */
+    static bool targeted(const uint16_t remaining, const size_t threshold) {
+        return remaining != 0 && (size_t) __builtin_popcount(remaining) <= threshold;
+    }
+
+    /**
+     * @brief Calls record on every product of one generator bucket and the stored matrices whose case may still be a target.
+     * @param generators The left factors, indexed by build().
+     * @param stored The right factors, indexed by build().
+     * @param g_bucket The generator bucket to probe with.
+     * @param want Returns whether a case is still a target.
+     * @param record Called with the positions of the generator and the stored matrix of each candidate product.
+     */
+    template <typename Want, typename Record>
+    static void probe(const index &generators, const index &stored, const size_t g_bucket, Want &&want, Record &&record) {
+        const std::vector<uint32_t> &g_positions = generators.buckets[g_bucket];
+        uint64_t pairs = 0, skipped = 0, from_residues = 0, multiplied = 0;
+        for (size_t s_bucket = 0; s_bucket < stored.buckets.size(); ++s_bucket) {
+            const std::vector<uint32_t> &s_positions = stored.buckets[s_bucket];
+            const uint64_t bucket_pairs = g_positions.size() * s_positions.size();
+            pairs += bucket_pairs;
+            const uint64_t product = int_product(generators.keys[g_bucket], stored.keys[s_bucket]);
+            if (product != 0) {
+                const uint8_t case_num = int_case(product);
+                if (!want(case_num)) {
+                    skipped += bucket_pairs;
+                    continue;
+                }
+                for (const uint32_t g : g_positions)
+                    for (const uint32_t s : s_positions) {
+                        if (!want(case_num)) break;     // Found by an earlier pair
+                        multiplied++;
+                        record(g, s);
+                    }
+                continue;
+            }
+            for (const uint32_t g : g_positions)
+                for (const uint32_t s : s_positions) {
+                    uint72_t bits;
+                    if (product_pattern(generators.residues[g], stored.residues[s], bits)) {
+                        from_residues++;
+                        if (!want(int_case(int_bits(bits)))) continue;
+                    }
+                    multiplied++;
+                    record(g, s);
+                }
+        }
+        stats.pairs += pairs;
+        stats.skipped += skipped;
+        stats.residue_products += from_residues;
+        stats.multiplied += multiplied;
+    }
+
+    static void report();
+    static void reset();
+
+private:
+    static counters stats;
+};
+
+#endif // JOIN_HPP
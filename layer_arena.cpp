@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+#include "layer_arena.hpp"
+
+/**
+ * @brief Maps anonymous memory aligned to a huge page and asks for it to be backed by huge pages.
+ * @param bytes The size, a multiple of HUGE_PAGE.
+ * @param huge_pages Set to whether the kernel accepted the advice.
+ */
+char *layer_arena::map(const size_t bytes, bool &huge_pages) {
+    void *raw = mmap(nullptr, bytes + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) throw std::bad_alloc();
+    // Trim the mapping to an aligned range so every huge page in it can be used
+    char *start = static_cast<char *>(raw);
+    char *aligned = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(start) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+    if (aligned > start) munmap(start, aligned - start);
+    munmap(aligned + bytes, start + bytes + HUGE_PAGE - aligned - bytes);
+#ifdef MADV_HUGEPAGE
+    huge_pages = madvise(aligned, bytes, MADV_HUGEPAGE) == 0;
+#else
+    huge_pages = false;
+#endif
+    return aligned;
+}
+
+/**
+ * @brief The next free chunk, reusing one from before the last reset if there is one.
+ */
+char *layer_arena::claim_chunk() {
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    if (claimed == chunks.size()) {
+        bool huge_pages;
+        chunks.push_back(map(CHUNK, huge_pages));
+        huge += huge_pages;
+    }
+    return chunks[claimed++];
+}
+
+/**
+ * @brief Allocates from the calling thread's chunk, claiming a new one when it is used up.
+ *
+ * Every allocation is aligned for any fundamental type, whatever the caller asks for. Containers
+ * such as TBB's skip list rebind the allocator to bytes and lay out their nodes inside, so the
+ * alignment they pass says nothing about the members of a node.
+ *
+ * @param bytes The size of the allocation.
+ * @param alignment A power of two no larger than a page.
+ */
+void *layer_arena::allocate(const size_t bytes, const size_t alignment) {
+    const size_t align = std::max(alignment, alignof(std::max_align_t));
+    if (bytes > CHUNK / 4) {
+        const size_t rounded = (bytes + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+        bool huge_pages;
+        char *p = map(rounded, huge_pages);
+        std::lock_guard<std::mutex> lock(chunk_mutex);
+        large.emplace_back(p, rounded);
+        large_bytes += rounded;
+        return p;
+    }
+    cursor &c = cursors.local();
+    char *p = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(c.next) + align - 1) & ~(align - 1));
+    if (!c.next || p + bytes > c.end) {
+        c.next = claim_chunk();
+        c.end = c.next + CHUNK;
+        p = c.next;
+    }
+    c.next = p + bytes;
+    return p;
+}
+
+/**
+ * @brief Bytes handed out since the last reset, counting the unused ends of chunks threads moved on from.
+ *        Only for use while nothing allocates from the arena.
+ */
+size_t layer_arena::used() const {
+    size_t unused = 0;
+    for (const cursor &c : cursors) unused += c.end - c.next;
+    return claimed * CHUNK - unused + large_bytes;
+}
+
+/**
+ * @brief Makes all of the arena's memory available again. Only for use while nothing allocates from it
+ *        and after everything allocated from it is destroyed.
+ */
+void layer_arena::reset() {
+    cursors.clear();
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    claimed = 0;
+    for (const auto &[p, bytes] : large) munmap(p, bytes);
+    large.clear();
+    large_bytes = 0;
+}
+
+/**
+ * @brief Returns all of the arena's memory to the system, under the same conditions as reset().
+ */
+void layer_arena::release() {
+    reset();
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    for (char *chunk : chunks) munmap(chunk, CHUNK);
+    chunks.clear();
+    huge = 0;
+}
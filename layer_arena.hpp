@@ -0,0 +1,91 @@
+#ifndef LAYER_ARENA_HPP
+#define LAYER_ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include <tbb/enumerable_thread_specific.h>
+
+/**
+ * @file layer_arena.hpp
+ * @brief Bump allocated memory for the layer being built, released all at once.
+ *
+ * A concurrent set allocates one node per matrix it holds, and freeing millions of them one at a
+ * time stalls the search between layers. A layer_arena hands out memory from large chunks instead,
+ * mapped with transparent huge pages where the kernel allows it. Every thread bumps a pointer
+ * through a chunk of its own, so allocation takes no lock except to claim the next chunk, and
+ * deallocation does nothing. reset() makes every chunk available again for the next layer without
+ * returning it to the system, and release() unmaps them.
+ *
+ * Only memory allocated through layer_arena::allocator comes from the arena. The frequency maps and
+ * histories inside each SO6 still use the heap, which is why bfs::advance() moves the matrices out
+ * of the set before clearing it.
+ */
+class layer_arena {
+public:
+    static constexpr size_t HUGE_PAGE = size_t(2) << 20;
+    static constexpr size_t CHUNK = 16 * HUGE_PAGE;
+
+    layer_arena() = default;
+    layer_arena(const layer_arena &) = delete;
+    layer_arena &operator=(const layer_arena &) = delete;
+    ~layer_arena() { release(); }
+
+    void *allocate(const size_t bytes, const size_t alignment);
+    void reset();
+    void release();
+    size_t reserved() const { return chunks.size() * CHUNK + large_bytes; }
+    size_t used() const;
+    size_t chunk_count() const { return chunks.size(); }
+    size_t huge_chunks() const { return huge; }
+
+    /**
+     * @brief Standard allocator drawing from an arena, or from the heap when default constructed.
+     */
+    template <typename T>
+    struct allocator {
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        layer_arena *owner = nullptr;
+
+        allocator() = default;
+        explicit allocator(layer_arena &arena) : owner(&arena) {}
+        template <typename U>
+        allocator(const allocator<U> &other) : owner(other.owner) {}
+
+        T *allocate(const size_t n) {
+            if (!owner) return std::allocator<T>().allocate(n);
+            return static_cast<T *>(owner->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T *p, const size_t n) {
+            if (!owner) std::allocator<T>().deallocate(p, n);      // Arena memory goes back with the whole arena
+        }
+
+        template <typename U>
+        bool operator==(const allocator<U> &other) const { return owner == other.owner; }
+    };
+
+private:
+    struct cursor {
+        char *next = nullptr;
+        char *end = nullptr;
+    };
+
+    char *claim_chunk();
+    static char *map(const size_t bytes, bool &huge_pages);
+
+    tbb::enumerable_thread_specific<cursor> cursors;
+    std::mutex chunk_mutex;             // Guards everything below
+    std::vector<char *> chunks;         // Every chunk of CHUNK bytes, handed out in order
+    size_t claimed = 0;                 // Chunks handed out since the last reset
+    std::vector<std::pair<char *, size_t>> large;     // Allocations too big for a chunk, unmapped on reset
+    size_t large_bytes = 0;
+    size_t huge = 0;                    // Chunks the kernel agreed to back with huge pages
+};
+
+#endif // LAYER_ARENA_HPP
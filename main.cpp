@@ -10,10 +10,26 @@
 
 #include <chrono>
 #include <fstream>
-#include <omp.h>
 #include <tbb/concurrent_unordered_set.h>
 #include <set>
 #include "Globals.hpp"
+#include "balance.hpp"
+#include "bfs.hpp"
+#include "budget.hpp"
+#include "circuit_io.hpp"
+#include "join.hpp"
+#include "layer_arena.hpp"
+#include "memory.hpp"
+#include "pipeline.hpp"
+#include "result_writer.hpp"
+#include "run_stats.hpp"
+#include "server.hpp"
+#include "shard.hpp"
+#include "symmetry.hpp"
+#include "synth.hpp"
+#include "tiling.hpp"
+#include "coverage.hpp"
+#include "pattern_io.hpp"
 #include "utils.hpp"
 
 /**
@@ -41,22 +57,12 @@ static tbb::concurrent_unordered_set<pattern> permutation_set(pattern &pat)
         while (std::next_permutation(row, row + 6))
         {
             // Create a new pattern based on the current permutation
-            pattern perm_of_orig;
-            for (int c = 0; c < 6; c++)
-            {
-                for (int r = 0; r < 6; r++)
-                    perm_of_orig.set(r,c, p.get(row[r],c));
-            }
+            pattern perm_of_orig = p.permute_rows(row);
             perms.insert(perm_of_orig);
             // Iterate over all possible combinations of row modifications
             for(unsigned int counter = 0; counter < (1 << 6); counter++) {
                 pattern mod_of_perm = perm_of_orig; // Start with a copy of the original permutation
-                for(int j = 0; j < 6; j++) {
-                    if((counter >> j) & 1) {
-                        // Modify the j-th row if the j-th bit of 'counter' is set
-                        mod_of_perm.mod_row(j);
-                    }
-                }
+                mod_of_perm.mod_rows(counter);      // Mod the j-th row if the j-th bit of 'counter' is set
                 perms.insert(mod_of_perm);
             }
         }
@@ -98,40 +104,35 @@ static void erase_all_permutations(pattern &p)
     }
 }
 
-/// @brief Reads binary patterns from a file and processes them.
-///        Each line in the file is expected to be a binary string representing a pattern.
-///        This function converts each line into a pattern object, orders it lexicographically,
-///        inserts all its permutations into a set, and then handles the identity pattern.
+/// @brief Reads patterns from a file and processes them.
+///        The file is either in the binary pattern format, which is loaded in parallel, or a text file
+///        with one pattern per line. Malformed patterns are reported and skipped, every remaining
+///        non-identity pattern is inserted into pattern_set, and then the identity pattern is removed.
 static void read_pattern_file(std::string pattern_file_path)
 {
     if(pattern_file_path.empty()) return;
 
     std::cout << "[Read] Reading patterns from " << pattern_file << std::endl;
-    std::ifstream patternFile(pattern_file_path); // More descriptive variable name
-
-    if (!patternFile.is_open())
-    {
-        std::cerr << "Failed to open pattern file: " << pattern_file_path << std::endl;
-        return;
-    }
-
-     // Renamed for clarity
-    std::string line;
-    int k = 0;
-    while (std::getline(patternFile, line))
-    {
-        pattern currentPattern(line); 
-        int case_num = currentPattern.case_num();
-        if(case_num == 0) continue;
-        insert_all_permutations(currentPattern);
-    }
-    patternFile.close(); // Close file after processing
+    pattern_io::load_result result = pattern_io::is_binary(pattern_file_path)
+                                    ? pattern_io::read_binary(pattern_file_path, pattern_set, THREADS)
+                                    : pattern_io::read_text(pattern_file_path, pattern_set);
 
     // Handle special case of the identity pattern
     pattern identityPattern = pattern::identity();
     pattern_set.unsafe_erase(identityPattern);
     pattern_set.unsafe_erase(identityPattern.pattern_mod());
-    std::cout << "[Finished] Loaded " << pattern_set.size() << " non-identity patterns." << std::endl;
+    std::cout << "[Finished] Read " << result.read << " patterns (" << result.malformed << " malformed). Loaded "
+              << pattern_set.size() << " non-identity patterns." << std::endl;
+}
+
+/// @brief Converts the text pattern file to the binary pattern format
+/// @param text_path the text or CSV pattern file
+/// @param binary_path the binary pattern file to write
+static void convert_pattern_file(const std::string &text_path, const std::string &binary_path)
+{
+    std::cout << "[Convert] Converting " << text_path << " to binary pattern file " << binary_path << std::endl;
+    pattern_io::load_result result = pattern_io::convert(text_path, binary_path);
+    std::cout << "[Finished] Wrote " << result.inserted << " patterns (" << result.malformed << " malformed lines skipped)." << std::endl;
 }
 
 static std::chrono::_V2::high_resolution_clock::time_point now()
@@ -142,51 +143,183 @@ static std::chrono::_V2::high_resolution_clock::time_point now()
 /**
  * @brief Erases the pattern of an SO6 from pattern_set
  * @param s the SO6 to be erased
+ * @param T the T count of s
  */
-static bool erase_pattern(SO6 &s) {
-    pattern pat = s.to_pattern();
-    bool ret = false;
-    if (pattern_set.contains(pat)) {
-        erase_all_permutations(pat);
-        ret = true;
-    }
-    return ret;
+static bool erase_pattern(SO6 &s, const int T) {
+    const uint72_t &bits = s.pattern_bits();          // Maintained incrementally, no matrix scan
+    pattern pat(bits.low_bits, bits.high_bits);
+    if (!coverage::wants(pat.case_num()) || !pattern_set.contains(pat)) return false;
+    if (!coverage::found(pat, T)) return false;    // Another thread already claimed this case
+    erase_all_permutations(pat);
+    run_stats::pattern_hit();
+    run_stats::set_patterns(pattern_set.size());
+    return true;
 }
 
 /**
- * @brief Erases the pattern of an SO6 from pattern_set
- * @param s the SO6 to be erased
+ * @brief Records the circuit of an SO6
+ * @param s the SO6 to be recorded
+ * @param of writer of the current T count
  */
-static void record_pattern(SO6 &s, std::ofstream& of) {
-    omp_set_lock(&omp_lock);
-    of << s.circuit_string() << std::endl;
-    omp_unset_lock(&omp_lock);
+static void record_pattern(SO6 &s, result_writer& of) {
+    of.record(s);
 }
 
 /**
  * @brief Erases the pattern of an SO6 from pattern_set
  * @param s the SO6 to be erased
+ * @param T the T count of s
  */
-static void erase_and_record_pattern(SO6 &s, std::ofstream& of) {
-    if(erase_pattern(s)) record_pattern(s,of);
+static void erase_and_record_pattern(SO6 &s, result_writer& of, const int T) {
+    if(erase_pattern(s, T)) record_pattern(s,of);
 }
 
-/// @brief Reads dat file and prints string of gates circuit
-/// @param file_name 
-static void read_dat(std::string file_name) {
-    std::string line;
-    std::ifstream file(file_name);
-    std::ofstream null_stream("/dev/null");
-    if (file.is_open()) {
-        while (getline(file, line)) {
-            SO6 s = SO6::reconstruct_from_circuit_string(line);
-            std::cout << "current size: " << pattern_set.size() << "\n";
-            erase_pattern(s);
-            std::cout << s.circuit_string() << "\n";
+/**
+ * @brief Left multiplies S by a tile of a generating set and records products with target patterns
+ *
+ * Products are formed a batch at a time and their patterns classified in one call. Only products
+ * whose case is still a target are rebuilt and looked up in pattern_set.
+ *
+ * @param S the matrix to be multiplied
+ * @param generating_set the left factors
+ * @param g_begin first generator of the tile
+ * @param g_end one past the last generator of the tile
+ * @param of output file stream
+ * @param T the T count of the products
+ */
+static void multiply_and_record(const SO6 &S, const packed_layer &generating_set, const size_t g_begin, const size_t g_end,
+                                result_writer &of, const int T) {
+    constexpr size_t BATCH = 256;
+    uint72_t products[BATCH];
+    uint8_t cases[BATCH];
+    SO6 G;      // Each generator is unpacked into the same matrix
+
+    for (size_t begin = g_begin; begin < g_end; begin += BATCH) {
+        if (!coverage::worth_computing()) return;
+        const size_t n = std::min(BATCH, g_end - begin);
+        for (size_t j = 0; j < n; ++j) {
+            generating_set.matrix(begin + j, G);
+            products[j] = (G * S).pattern_bits();
+        }
+        run_stats::children(n);
+        if (cases_flag) continue;
+
+        pattern::case_nums(products, n, cases);
+        for (size_t j = 0; j < n; ++j) {
+            if (!coverage::wants(cases[j])) continue;
+            generating_set.matrix(begin + j, G);
+            SO6 N = G * S;     // Rebuild the candidate to record its circuit
+            erase_and_record_pattern(N, of, T);
         }
     }
 }
 
+/**
+ * @brief Computes the products of a block of stored matrices for the current free multiply layer
+ *
+ * The products are formed in the tile order set by tiling::set(), so tiles of the generating set stay
+ * in cache while a block of stored matrices is multiplied by them. With transpose symmetry the
+ * transpose of each stored matrix is multiplied as well.
+ *
+ * @param stored the stored matrices
+ * @param begin first stored matrix of the block
+ * @param end one past the last stored matrix of the block
+ * @param generating_set the generating set of this layer, unused for the first layer
+ * @param of output file stream
+ * @param curr_T_count the T count of the stored layer before this free multiply step
+ */
+static void free_multiply(const packed_layer &stored, const size_t begin, const size_t end,
+                          const packed_layer &generating_set, result_writer &of, const int curr_T_count) {
+    if (curr_T_count == stored_depth_max)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            if (!coverage::worth_computing()) return;     // Skip the rest of this block once everything is found
+            const SO6 S = stored[i];
+            for (int o = 0; o < symmetry::orientations(); ++o) {
+                SO6 N = (o == 0 ? S : S.transpose(false)).left_multiply_by_T(0);
+                run_stats::children(1);
+                if (!cases_flag) erase_and_record_pattern(N, of, curr_T_count + 1);
+            }
+            run_stats::work_done();
+        }
+        return;
+    }
+
+    tiling::for_each_tile(end - begin, generating_set.size(), tiling::get(), [&](const size_t i, const size_t g_begin, const size_t g_end) {
+        const SO6 S = stored.matrix(begin + i);     // Only multiplied, so its frequency maps are not rebuilt
+        multiply_and_record(S, generating_set, g_begin, g_end, of, curr_T_count + 1);
+        if (symmetry::enabled()) multiply_and_record(S.transpose(false), generating_set, g_begin, g_end, of, curr_T_count + 1);
+        if (g_end == generating_set.size()) run_stats::work_done();     // Last tile of this stored matrix
+    });
+}
+
+/**
+ * @brief Computes the products of one shard's stored matrices that may still have a target pattern
+ *
+ * Used instead of free_multiply() once few patterns remain. Both operands are bucketed by join::build()
+ * and each bucket of generators probes the stored buckets, so only the products whose case is still a
+ * target, or cannot be told from residues, are formed.
+ *
+ * @param stored the stored matrices of the shard
+ * @param generating_set the generating set of this layer
+ * @param of output file stream
+ * @param curr_T_count the T count of the stored layer before this free multiply step
+ */
+static void targeted_multiply(const packed_layer &stored, const packed_layer &generating_set,
+                              result_writer &of, const int curr_T_count) {
+    const join::index generators = join::build(generating_set);
+    packed_layer both;      // With transpose symmetry, the stored matrices followed by their transposes
+    if (symmetry::enabled()) {
+        both.reserve(2 * stored.size());
+        for (size_t i = 0; i < stored.size(); ++i) both.push_back(stored.matrix(i));
+        for (size_t i = 0; i < stored.size(); ++i) both.push_back(stored.matrix(i).transpose(false));
+    }
+    const packed_layer &factors = symmetry::enabled() ? both : stored;
+    const join::index stored_index = join::build(factors);
+    std::atomic<uint64_t> generators_done{0};
+    tbb::parallel_for(size_t(0), generators.buckets.size(), [&](const size_t b) {
+        if (coverage::worth_computing()) {
+            join::probe(generators, stored_index, b, [](const uint8_t case_num) { return coverage::wants(case_num); },
+                        [&](const uint32_t g, const uint32_t s) {
+                            SO6 N = generating_set.matrix(g) * factors.matrix(s);
+                            run_stats::children(1);
+                            erase_and_record_pattern(N, of, curr_T_count + 1);
+                        });
+        }
+        // Credit the stored matrices in proportion to the generators probed so far
+        const uint64_t count = generators.buckets[b].size();
+        const uint64_t before = generators_done.fetch_add(count);
+        run_stats::work_done(stored.size() * (before + count) / generating_set.size() - stored.size() * before / generating_set.size());
+    });
+}
+
+/// @brief Converts a circuit file between the text and binary formats
+///        Binary and compressed files are written as text, and text files as binary, or compressed with -z.
+/// @param in_path the text, binary or compressed circuit file
+/// @param out_path the converted file to write
+static void convert_dat_file(const std::string &in_path, const std::string &out_path)
+{
+    const result_writer::format to = circuit_io::format_of(in_path) != result_writer::TEXT ? result_writer::TEXT
+                                     : compress_output ? result_writer::COMPRESSED : result_writer::BINARY;
+    static const char *names[] = {"text", "binary", "compressed"};
+    std::cout << "[Convert] Converting " << in_path << " to " << names[to] << " circuit file " << out_path << std::endl;
+    const circuit_io::load_result result = circuit_io::convert(in_path, out_path, to);
+    std::cout << "[Finished] Wrote " << result.read << " circuits (" << result.malformed << " malformed "
+              << (result.format == result_writer::TEXT ? "lines" : "records") << " skipped)." << std::endl;
+}
+
+/// @brief Reads dat file and prints string of gates circuit
+/// @param file_name the text, binary or compressed circuit file
+static void read_dat(std::string file_name) {
+    const circuit_io::load_result result = circuit_io::read(file_name, [](const std::vector<unsigned char> &hist) {
+        SO6 s = circuit_io::replay(hist);
+        erase_pattern(s, circuit_io::gates(hist));
+        std::cout << s.circuit_string() << "\n";
+    });
+    std::cout << "[Read] " << result.read << " circuits (" << result.malformed << " malformed skipped), "
+              << pattern_set.size() << " patterns remain." << std::endl;
+}
+
 static std::string time_since(std::chrono::_V2::high_resolution_clock::time_point &s)
 {
     std::chrono::duration<double> duration = now() - s;
@@ -211,30 +344,17 @@ static void report_begin_T_count(const int T) {
     tcount_init_time = now();
 }
 
-/**
- * @brief Method to report percentage completed
- * @param c current integer countr
- * @param s total size
- */
-inline static void report_percent_complete(const uint64_t &c, const uint64_t s)
-{
-    if ((c & 0x7F) == 0) // if c is divisible by 128
-    {
-        std::cout << "\033[A\033[A\r ||\t↪ [Progress] Processing .....    "
-                  << (100*c/s) << "\%" << "\n ||\t↪ [Patterns] "
-                  << pattern_set.size() << " patterns remain." << std::endl;
-    }
-}
-
 /**
  * @brief Function to report completion
  * @param matrices_found how many matrices were found
  * @param b flag indicating whether to print the number of matrices found
- * @param of output file stream to close
+ * @param of writer to close
  */
-static void finish_io(const uint &matrices_found, const bool b, std::ofstream &of) {
-    std::cout << "\033[A\033[A\r ||\t↪ [Progress] Processing .....    100%" << std::endl; 
+static void finish_io(const uint &matrices_found, const bool b, result_writer &of) {
+    run_stats::end_layer();                  // The reporter no longer redraws the progress lines
+    std::cout << run_stats::rewind(2) << " ||\t↪ [Progress] Processing .....    100%" << (run_stats::plain() ? "" : "\033[K") << std::endl;
     std::cout << " ||\t↪ [Patterns] " << pattern_set.size() << " patterns remain." << std::endl;
+    std::cout << " ||\t↪ [Memory] " << memory::summary() << std::endl;
     if (b) {
         std::cout << " ||\t↪ [Finished] Found " << matrices_found << " new matrices in " << time_since(tcount_init_time) << "\n ||" << std::endl;
     } else {
@@ -243,7 +363,27 @@ static void finish_io(const uint &matrices_found, const bool b, std::ofstream &o
     of.close();
 }
 
-static std::ofstream prepare_T_count_io(const int t, uint8_t &stored_depth_max, uint8_t &target_T_count) {
+/**
+ * @brief Records the sizes of the pattern set and the generating sets and takes the memory snapshot of a T count
+ * @param T the T count
+ * @param generating_set the generating sets
+ * @param replicas copies of a generating set on other NUMA nodes
+ */
+static void account_memory(const int T, const std::vector<packed_layer> &generating_set, const bfs::layer &replicas = {}) {
+    memory::track(memory::PATTERN_SET, pattern_set.size(), pattern_set.size() * memory::skiplist_node_bytes<pattern>());
+    memory::usage generators = memory::sum(generating_set);
+    generators.bytes += memory::sum(replicas).bytes;
+    memory::track(memory::GENERATING_SET, generators.elements, generators.bytes);
+    memory::take(T);
+}
+
+/**
+ * @brief Opens the writer of a T count and starts reporting its progress
+ * @param t the T count
+ * @param work number of matrices the T count will process
+ * @return the writer of the T count
+ */
+static std::unique_ptr<result_writer> prepare_T_count_io(const int t, const uint64_t work, uint8_t &stored_depth_max, uint8_t &target_T_count) {
     int free_multiply_depth = utils::free_multiply_depth(target_T_count,stored_depth_max);
     // Begin reporting for T=1 with specific depth information
     if (t == 1) {
@@ -253,18 +393,38 @@ static std::ofstream prepare_T_count_io(const int t, uint8_t &stored_depth_max,
     }
 
     report_begin_T_count(t);
-    std::string file_string = "./data/" + std::to_string(t) + ".dat";
-    std::ofstream of;
-    of.open(file_string, std::ios::out | std::ios::trunc);
-    if (!of.is_open()) std::exit(0);
+    std::string file_string = shard::output_path(t);
+    auto of = std::make_unique<result_writer>(file_string, compress_output ? result_writer::COMPRESSED : binary_output ? result_writer::BINARY : result_writer::TEXT);
+    if (!of->is_open()) std::exit(0);
     std::cout << " ||\t↪ [Save] Opening file " << file_string << "\n"
               << (t == stored_depth_max + 1 ? " ||\t↪ [Rep] Left multiplying everything by T₀\n" : 
-                  (t > stored_depth_max + 1 ? " ||\t↪ [Rep] Using generating_set[" + std::to_string(t - stored_depth_max - 1) + "]\n" : ""))
-              << " ||\t↪ [Progress] Processing .....    0%\n"
-              << " ||\t↪ [Patterns] " << pattern_set.size() << " patterns remain." << std::endl;
+                  (t > stored_depth_max + 1 ? " ||\t↪ [Rep] Using generating_set[" + std::to_string(t - stored_depth_max - 1) + "]\n" : ""));
+    if (!run_stats::plain()) {
+        std::cout << " ||\t↪ [Progress] Processing .....    0%\n"
+                  << " ||\t↪ [Patterns] " << pattern_set.size() << " patterns remain." << std::endl;
+    }
+    run_stats::set_patterns(pattern_set.size());
+    run_stats::begin_layer(t, t <= stored_depth_max ? "bfs" : "free_multiply", work);
     return of;
 }
 
+/**
+ * @brief Reports the total run time and coverage, ending the run.
+ * @param program_init_time time at which the program started
+ * @return The exit status of the program.
+ */
+static int finish_run(std::chrono::_V2::high_resolution_clock::time_point &program_init_time) {
+    run_stats::stop();
+    std::cout << "[Time] Total time elapsed: " << time_since(program_init_time) << std::endl;
+    std::cout << " Even calls: " << counter_even << " Odd calls: " << counter_odd << " Zero calls: " << counter_zero << std::endl;
+    coverage::report();
+    if (pipeline::enabled()) pipeline::report();
+    balance::report(THREADS);
+    join::report();
+    bfs::report();
+    return 0;
+}
+
 /**
  * @brief Store specific cosets T_0{curr} based on the current T count and free multiply depth.
  * This method saves a subset of the SO6 objects to the generating set, which are used in later iterations.
@@ -273,26 +433,154 @@ static std::ofstream prepare_T_count_io(const int t, uint8_t &stored_depth_max,
  * @param free_multiply_depth The depth until which free multiplication is performed.
  * @param num_generating_sets The total number of generating sets.
  * @param current The current set of SO6 objects.
- * @param generating_set Reference to an array of vectors of SO6 objects to store the generated sets.
+ * @param generating_set Receives the generating set, packed.
  */
 void storeCosets(int curr_T_count, 
-                 tbb::concurrent_set<SO6>& current, std::vector<SO6> &generating_set)
+                 const bfs::layer& current, packed_layer &generating_set)
 {
-    int ngs = utils::num_generating_sets(target_T_count,stored_depth_max);
+    // Under a memory budget the stored depth is not known yet, so keep the cosets the least stored depth needs
+    int ngs = utils::num_generating_sets(target_T_count, budget::active() ? budget::lowest_depth(target_T_count) : stored_depth_max);
     if (curr_T_count < ngs)
     {
-        std::cout << "\033[A\r ||\t↪ [Save] Saving coset T₀{T=" << curr_T_count + 1 << "} as generating_set[" << curr_T_count << "]\n ||" << std::endl;
-        generating_set = std::vector<SO6>(current.begin(),current.end());
-        generating_set.erase(std::remove_if(generating_set.begin(), generating_set.end(),
-                                [](SO6& S) {
-                                    return (S.circuit_string().back() == '0');
-                                }),
-                    generating_set.end());
-
-        for(SO6 &S : generating_set) {
-                S = S.left_multiply_by_T(0);
+        std::cout << run_stats::rewind(1) << " ||\t↪ [Save] Saving coset T₀{T=" << curr_T_count + 1 << "} as generating_set[" << curr_T_count << "]\n ||" << std::endl;
+        generating_set.clear();
+        auto add_coset = [&](SO6 S) {
+            if (S.circuit_string().back() != '0') generating_set.push_back(S.left_multiply_by_T(0));
+        };
+        for (const packed_layer &shard : current)
+            for (size_t i = 0; i < shard.size(); ++i) add_coset(shard[i]);
+        if (symmetry::enabled()) {      // Generating sets hold both classes of every pair
+            for (const packed_layer &shard : current)
+                for (size_t i = 0; i < shard.size(); ++i) {
+                    const SO6 S = shard[i];
+                    if (!symmetry::self_inverse(S)) add_coset(S.transpose(false));
+                }
+        }
+    }
+}
+
+/**
+ * @brief Runs the BFS phase from the root up to stored_depth_max, recording patterns and saving cosets.
+ * @param current Holds the root on entry and the last stored layer on exit.
+ * @param generating_set Receives the generating sets.
+ */
+static void run_bfs(bfs::layer &current, std::vector<packed_layer> &generating_set)
+{
+    bfs::layer prior(numa::shards());     // Sorted layers T-1 and T, one packed_layer per shard
+    std::vector<std::unique_ptr<layer_arena>> arenas;   // Nodes of the layer being built, reused every layer
+    for (size_t k = 0; k < numa::shards(); ++k) arenas.push_back(std::make_unique<layer_arena>());   // Pages are touched first by the shard's own workers
+    bfs::next_layer next = bfs::next_layers(arenas);
+
+    for (int curr_T_count = 0; curr_T_count < stored_depth_max; ++curr_T_count)
+    {
+        if (!coverage::worth_computing()) break;
+        std::unique_ptr<result_writer> of = prepare_T_count_io(curr_T_count+1, bfs::size(current), stored_depth_max, target_T_count);
+
+        if (pipeline::enabled()) {
+            pipeline::expand(current[0], prior[0], next[0],
+                [&](SO6 &N) { return erase_pattern(N, curr_T_count + 1); },
+                [&](SO6 &N) { record_pattern(N, *of); });
+        } else {
+            bfs::expand(current, prior, next,
+                [&](SO6 &N) {
+                    erase_and_record_pattern(N, *of, curr_T_count + 1);
+                    if (symmetry::enabled()) {      // The other class of the pair has its own pattern
+                        SO6 inverse = N.transpose(false);
+                        erase_and_record_pattern(inverse, *of, curr_T_count + 1);
+                    }
+                },
+                [](size_t) { run_stats::work_done(); });
+        }
+
+        memory::usage building;     // The layer being built at its largest, just before it is packed
+        for (size_t k = 0; k < next.size(); ++k) {
+            building.elements += next[k].size();
+            building.bytes += arenas[k]->used() + memory::heap_bytes(next[k]);
+        }
+        memory::track(memory::NEXT, building.elements, building.bytes);
+
+        bfs::advance(prior, current, next); // current is now ready for next iteration
+        const memory::usage stored_prior = memory::sum(prior), stored = memory::sum(current);
+        memory::track(memory::PRIOR, stored_prior.elements, stored_prior.bytes);
+        memory::track(memory::CURRENT, stored.elements, stored.bytes);
+        account_memory(curr_T_count + 1, generating_set);
+        run_stats::record_layer(curr_T_count + 1, stored.elements, stored.bytes);
+        const double layer_seconds = std::chrono::duration<double>(now() - tcount_init_time).count();
+        finish_io(bfs::size(current), true, *of);
+        if (curr_T_count < (int) generating_set.size()) storeCosets(curr_T_count, current, generating_set[curr_T_count]);
+
+        if (budget::active()) {
+            budget::record_layer(curr_T_count + 1, stored.elements, layer_seconds);
+            budget::time_products(current[0], THREADS);
+            const uint64_t untracked = memory::rss() - std::min(memory::rss(), memory::tracked());
+            if (!budget::keep_storing(curr_T_count + 1, target_T_count, untracked + memory::project())) stored_depth_max = curr_T_count + 1;
+            if (!budget::describe().empty()) std::cout << run_stats::rewind(1) << " ||\t↪ [Budget] " << budget::describe() << "\n ||" << std::endl;
         }
     }
+
+    size_t reserved = 0, huge = 0, chunks = 0;
+    for (const std::unique_ptr<layer_arena> &arena : arenas) {
+        reserved += arena->reserved();
+        huge += arena->huge_chunks();
+        chunks += arena->chunk_count();
+    }
+    if (reserved) std::cout << "[Arena] " << reserved / (1 << 20) << " MB reserved for BFS layers, " << huge << " of " << chunks << " chunks on huge pages" << std::endl;
+}
+
+/**
+ * @brief Saves the stored layer and generating sets so --shard processes can skip the BFS phase.
+ * @param current The last stored layer.
+ * @param generating_set The generating sets.
+ */
+static void save_layers(const bfs::layer &current, const std::vector<packed_layer> &generating_set)
+{
+    shard::save_layer("stored", current);
+    for (size_t g = 0; g < generating_set.size(); ++g) shard::save_layer("generating_" + std::to_string(g), bfs::layer(1, generating_set[g]));
+    shard::save_manifest(target_T_count, stored_depth_max);
+    coverage::save(shard::layer_coverage_path());     // Shards skip the cases the BFS phase already found
+    std::cout << "[Shard] Saved the stored layer and " << generating_set.size() << " generating sets to " << shard::LAYER_DIR << std::endl;
+}
+
+/**
+ * @brief Loads the layers saved by a --save_layers run, keeping only this shard's stored matrices.
+ * @param current Receives this shard's slice of the stored layer.
+ * @param generating_set Receives the generating sets.
+ * @return false if the saved layers are missing or were built for other depths.
+ */
+static bool load_layers(bfs::layer &current, std::vector<packed_layer> &generating_set)
+{
+    if (!shard::check_manifest(target_T_count, stored_depth_max)) return false;
+    coverage::merge(shard::layer_coverage_path());
+    try {
+        current = bfs::layer(numa::shards());
+        const packed_layer stored = shard::load_layer("stored", true);
+        for (size_t i = 0; i < stored.size(); ++i) {
+            const SO6 S = stored.matrix(i);
+            current[numa::shard_of(S)].push_back(S);
+        }
+        for (size_t g = 0; g < generating_set.size(); ++g) generating_set[g] = shard::load_layer("generating_" + std::to_string(g), false);
+    } catch (const std::exception &e) {
+        std::cerr << "[Shard] " << e.what() << std::endl;
+        return false;
+    }
+    std::cout << "[Shard] Shard " << shard::index() << " of " << shard::total() << " loaded " << bfs::size(current)
+              << " stored matrices and " << generating_set.size() << " generating sets" << std::endl;
+    return true;
+}
+
+/**
+ * @brief Merges the outputs and coverage of the shard processes of a run.
+ * @param shards Number of shards.
+ * @param program_init_time time at which the program started
+ * @return The exit status of the program.
+ */
+static int merge_shards(const int shards, std::chrono::_V2::high_resolution_clock::time_point &program_init_time)
+{
+    shard::merge_outputs(shards, stored_depth_max + 1, target_T_count);
+    coverage::merge(shard::layer_coverage_path());
+    for (int i = 0; i < shards; ++i)
+        if (!coverage::merge(shard::coverage_path(i, shards))) std::cerr << "[Merge] Missing " << shard::coverage_path(i, shards) << std::endl;
+    return finish_run(program_init_time);
 }
 
 /**
@@ -310,101 +598,105 @@ int main(int argc, char **argv)
     auto program_init_time = now();          // Begin timekeeping
     Globals::setParameters(argc, argv);      // Initialize parameters to command line argument
     Globals::configure();                    // Configure the globals to remove inconsistencies
+    if (!pattern_convert_file.empty()) {     // Only convert the pattern file to binary
+        convert_pattern_file(pattern_file, pattern_convert_file);
+        return 0;
+    }
+    if (!dat_convert_paths.empty()) {        // Only convert the circuit file
+        convert_dat_file(dat_convert_paths[0], dat_convert_paths[1]);
+        return 0;
+    }
+    if (!query_file.empty()) {               // Only answer the synthesis queries
+        synth::run_file(query_file, target_T_count);
+        return 0;
+    }
+    if (!serve_target.empty()) {             // Keep the layers resident and answer queries until shut down
+        auto start = now();
+        synth::prepare(serve_depth, true);
+        std::cout << "[Serve] Layers to T=" << synth::resident_depth() << " resident after " << time_since(start) << std::endl;
+        return serve_target == "-" ? server::serve_stdin(target_T_count) : server::serve_socket(serve_target, target_T_count);
+    }
+    run_stats::start(stats_file, stats_interval, plain_log);     // Report progress from a background thread
     read_pattern_file(pattern_file);         // Read the pattern file
-
-    tbb::concurrent_set<SO6> prior, current = tbb::concurrent_set<SO6>({root});
+    coverage::begin(pattern_set);            // Track the loaded patterns so we can stop once all are found
+    if (merge_shard_count > 0) return merge_shards(merge_shard_count, program_init_time);
+    if (!read_dat_file.empty()) {            // Only replay the circuits of a file against the patterns
+        read_dat(read_dat_file);
+        return finish_run(program_init_time);
+    }
 
     // This stores the generating sets. Note that the initial generating set is just the 15 T matrices and, thus, doesn't need to be stored
-    int ngs = utils::num_generating_sets(target_T_count, stored_depth_max);
+    int ngs = utils::num_generating_sets(target_T_count, budget::active() ? budget::lowest_depth(target_T_count) : stored_depth_max);
 
-    std::vector<SO6> generating_set[ngs];    
+    std::vector<packed_layer> generating_set(std::max(0, ngs));
+    bfs::layer current;
 
-    std::mutex mtx;
-    std::atomic<bool> lock_held{false};
-
-    for (int curr_T_count = 0; curr_T_count < stored_depth_max; ++curr_T_count)
-    {
-        tbb::concurrent_set<SO6> next;
-        std::ofstream of = prepare_T_count_io(curr_T_count+1,stored_depth_max,target_T_count);
-
-        tbb::concurrent_unordered_set<pattern> patterns;
-
-        uint64_t count = 0, interval_size = (15*current.size()) / THREADS;
-
-        int insert_counter = 0;
-        #pragma omp parallel num_threads(THREADS)
-        {
-            int thread_id = omp_get_thread_num();
-            #pragma omp for collapse(2) schedule(dynamic) nowait
-            for (size_t i = 0; i < current.size(); ++i) for (int T = 0; T < 15; T++)
-            {                
-                if (thread_id == 0)  report_percent_complete(++count, interval_size);
-
-                auto it = std::next(current.begin(), i);
-                const SO6& S = *it;
-                SO6 toInsert = S.left_multiply_by_T(T);
-                if(prior.find(toInsert) == prior.end()) {       // This used to be done by finding the differences later, but this works better with the concurrent set
-                    if(next.insert(toInsert).second) {
-                        erase_and_record_pattern(toInsert, of);
-                    }
-                }
-            }
+    if (shard::active()) {
+        if (!load_layers(current, generating_set)) return EXIT_FAILURE;
+    } else {
+        current = bfs::root_layer(root);
+        run_bfs(current, generating_set);
+        if (budget::active()) {     // Layers deeper than the chosen stored depth need fewer generating sets
+            generating_set.resize(std::max(0, utils::num_generating_sets(target_T_count, stored_depth_max)));
+            std::cout << "[Budget] Stored depth T=" << (int) stored_depth_max << ", peak resident set " << (memory::peak_rss() >> 20) << " MB of "
+                      << (budget::limit() >> 20) << " MB" << std::endl;
+        }
+        if (save_layers_flag) {
+            save_layers(current, generating_set);
+            return finish_run(program_init_time);
+        }
+        if (!coverage::worth_computing()) {
+            std::cout << " ||\n[Coverage] All target patterns found, skipping the remaining layers.\n" << std::endl;
+            return finish_run(program_init_time);
         }
-
-        utils::rotate_and_clear(prior, current, next); // current is now ready for next iteration
-        finish_io(current.size(), true, of);
-        storeCosets(curr_T_count, current, generating_set[curr_T_count]);
     }
-    
-    tbb::concurrent_set<SO6>().swap(prior); // Swap to clear
     std::cout << " ||\n[End] Stored T=" << (int)stored_depth_max << " as current to generate T=" << stored_depth_max + 1 << " through T=" << (int)target_T_count << "\n" << std::endl;
 
-    std::vector<SO6> to_compute = utils::convert_to_vector_and_clear(current);
+    bfs::layer to_compute = std::move(current);
+    numa::for_each_shard([&](const size_t k) { utils::shuffle(to_compute[k]); });
+    const memory::usage stored = memory::sum(to_compute);
+    for (const memory::structure s : {memory::PRIOR, memory::CURRENT, memory::NEXT}) memory::track(s, 0, 0);     // Freed with the BFS phase
+    memory::track(memory::TO_COMPUTE, stored.elements, stored.bytes);
 
     std::cout << "[Report] Current patterns: " << pattern_set.size() << std::endl;
 
     std::cout << "[Begin] Beginning brute force multiply.\n ||" << std::endl;
-    uint64_t set_size = to_compute.size();
-    uint64_t interval_size = std::ceil(set_size / THREADS); // Equally divide among threads, not sure how to balance but each should take about the same time
 
     for (int curr_T_count = stored_depth_max; curr_T_count < target_T_count; ++curr_T_count)
     {    
-        std::ofstream of = prepare_T_count_io(curr_T_count+1,stored_depth_max, target_T_count);
-
-        std::vector<std::ofstream> file_stream(THREADS);
-
-        omp_init_lock(&omp_lock);
-        #pragma omp parallel for schedule(static, interval_size) num_threads(THREADS)
-        for (uint64_t i = 0; i < set_size; i++)
-        {
-            int current_thread = omp_get_thread_num();
-            const SO6 &S = to_compute.at(i); 
-            if (omp_get_thread_num() == 0)
-                report_percent_complete(i % interval_size, interval_size);
-
-            if (curr_T_count == stored_depth_max)
-            {
-                SO6 N = S.left_multiply_by_T(0);
-                if(!cases_flag) {
-                    erase_and_record_pattern(N, of);
-                    continue;
-                }
-            }
-
-            for (const SO6 &G : generating_set[curr_T_count-stored_depth_max - 1])
-            {
-                SO6 N = G*S; 
-                if(!cases_flag) {
-                    erase_and_record_pattern(N, of);
-                    continue;
-                }
-            }
+        if (!coverage::worth_computing()) {
+            std::cout << " ||\t[Coverage] All target patterns found, skipping T=" << curr_T_count + 1 << " through T=" << (int)target_T_count << std::endl;
+            break;
+        }
+        static const packed_layer no_generators;     // The first free multiply layer only multiplies by T₀
+        const packed_layer &layer_generators = curr_T_count > stored_depth_max ? generating_set[curr_T_count - stored_depth_max - 1] : no_generators;
+        const bool targeted = !layer_generators.empty() && !cases_flag && join::targeted(coverage::remaining(), targeted_threshold);
+        if (targeted) {
+            std::cout << " ||\t[Join] T=" << curr_T_count + 1 << ": " << __builtin_popcount(coverage::remaining()) << " target cases remain, probing "
+                      << layer_generators.size() << " generators against the stored matrices by integer bits" << std::endl;
+        } else if (!layer_generators.empty()) {
+            const tiling::shape tile = tiling::tune(layer_generators, to_compute[0]);
+            tiling::set(tile);
+            std::cout << " ||\t[Tile] T=" << curr_T_count + 1 << ": " << tile.generators << " generators per tile, "
+                      << tile.stored << " stored matrices per block (" << tiling::describe(tiling::detect()) << ")" << std::endl;
         }
-        omp_destroy_lock(&omp_lock);
-        finish_io(0, false, of);
-        for(auto &stream : file_stream) stream.close();
+        std::unique_ptr<result_writer> of = prepare_T_count_io(curr_T_count+1, bfs::size(to_compute), stored_depth_max, target_T_count);
+
+        // In NUMA mode each shard multiplies its own stored matrices by a copy of the generating set on its node
+        const bfs::layer local_generators = numa::sharded() ? numa::replicate(layer_generators) : bfs::layer();
+        balance::begin();
+        numa::for_each_shard([&](const size_t k) {
+            const packed_layer &generators = numa::sharded() ? local_generators[k] : layer_generators;
+            if (targeted) return targeted_multiply(to_compute[k], generators, *of, curr_T_count);
+            balance::run_chunks(to_compute[k], [&](const size_t begin, const size_t end) {
+                free_multiply(to_compute[k], begin, end, generators, *of, curr_T_count);
+            });
+        });
+        balance::end();
+        account_memory(curr_T_count + 1, generating_set, local_generators);
+        finish_io(0, false, *of);
     }
-    std::cout << " ||\n[Finished] Free multiply complete.\n\n[Time] Total time elapsed: " << time_since(program_init_time) << std::endl;
-    std::cout << " Even calls: " << counter_even << " Odd calls: " << counter_odd << " Zero calls: " << counter_zero << std::endl;
-    return 0;
+    std::cout << " ||\n[Finished] Free multiply complete.\n" << std::endl;
+    if (shard::active()) coverage::save(shard::coverage_path(shard::index(), shard::total()));
+    return finish_run(program_init_time);
 }
@@ -0,0 +1,152 @@
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "memory.hpp"
+
+std::atomic<uint64_t> memory::elements[memory::STRUCTURES];
+std::atomic<uint64_t> memory::bytes[memory::STRUCTURES];
+std::atomic<uint64_t> memory::highest_rss{0};
+std::mutex memory::snapshot_mutex;
+std::vector<memory::snapshot> memory::snapshots;
+
+static const char *structure_names[memory::STRUCTURES] = {"prior", "current", "next", "generating_set", "to_compute", "pattern_set"};
+
+const char *memory::name(const structure s) {
+    return structure_names[s];
+}
+
+/**
+ * @brief Records the current size of a structure, replacing what was recorded before.
+ * @param s The structure.
+ * @param n Number of elements it holds.
+ * @param b Bytes it holds, including what its elements hold on the heap.
+ */
+void memory::track(const structure s, const uint64_t n, const uint64_t b) {
+    elements[s].store(n, std::memory_order_relaxed);
+    bytes[s].store(b, std::memory_order_relaxed);
+}
+
+memory::usage memory::of(const structure s) {
+    return {elements[s].load(std::memory_order_relaxed), bytes[s].load(std::memory_order_relaxed)};
+}
+
+/**
+ * @brief Total bytes of every tracked structure.
+ */
+uint64_t memory::tracked() {
+    uint64_t total = 0;
+    for (int s = 0; s < STRUCTURES; ++s) total += bytes[s].load(std::memory_order_relaxed);
+    return total;
+}
+
+/**
+ * @brief The resident set of the process, in bytes, or 0 where /proc is unavailable.
+ */
+uint64_t memory::rss() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    const uint64_t b = resident * sysconf(_SC_PAGESIZE);
+    uint64_t seen = highest_rss.load(std::memory_order_relaxed);
+    while (b > seen && !highest_rss.compare_exchange_weak(seen, b)) {}
+    return b;
+}
+
+/**
+ * @brief The largest resident set of the process so far, in bytes.
+ *
+ * The kernel's high water mark counts pages differently from /proc/self/statm, so the largest
+ * resident set rss() has read is taken too, and the peak never reads below a resident set printed before it.
+ */
+uint64_t memory::peak_rss() {
+    rss();      // Counts the current resident set in highest_rss
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return highest_rss.load();
+    return std::max<uint64_t>((uint64_t) usage.ru_maxrss * 1024, highest_rss.load());    // Kilobytes on Linux
+}
+
+/**
+ * @brief Records the tracked sizes and the resident set at the end of a layer.
+ * @param T The T count of the layer.
+ */
+memory::snapshot memory::take(const int T) {
+    snapshot now;
+    now.T = T;
+    for (int s = 0; s < STRUCTURES; ++s) now.structures[s] = of((structure) s);
+    now.rss = rss();
+    now.peak_rss = peak_rss();
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    snapshots.push_back(now);
+    return now;
+}
+
+/**
+ * @brief Estimates the tracked bytes at the peak of the next BFS layer, or 0 before two layers are known.
+ *
+ * The next layer holds current times the growth from prior to current. While it is built, prior and
+ * current stay and the layer being built grows by the same factor. While it is packed, current and
+ * the packed next layer are held instead of prior.
+ */
+uint64_t memory::project() {
+    const usage p = of(PRIOR), c = of(CURRENT), n = of(NEXT);
+    if (p.elements == 0 || c.elements == 0 || n.elements == 0) return 0;
+    const double growth = (double) c.elements / p.elements;
+    const uint64_t others = tracked() - p.bytes - c.bytes - n.bytes;
+    return others + c.bytes + n.bytes * growth + std::max<double>(p.bytes, c.bytes * growth);
+}
+
+static std::string megabytes(const uint64_t b) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << b / 1048576.0 << " MB";
+    return out.str();
+}
+
+/**
+ * @brief One line of the structures that hold anything, the resident set and, during the BFS, the projection.
+ */
+std::string memory::summary() {
+    std::ostringstream out;
+    for (int s = 0; s < STRUCTURES; ++s) {
+        const usage u = of((structure) s);
+        if (u.elements == 0) continue;
+        out << structure_names[s] << " " << megabytes(u.bytes) << " (" << u.elements << "), ";
+    }
+    out << "RSS " << megabytes(rss()) << ", peak " << megabytes(peak_rss());
+    if (const uint64_t next = project()) out << ", next layer about " << megabytes(next) << " tracked";
+    return out.str();
+}
+
+static void write_structures(std::ostringstream &out, const memory::usage *structures) {
+    for (int s = 0; s < memory::STRUCTURES; ++s)
+        out << (s ? ", " : "") << "\"" << structure_names[s] << "\": {\"elements\": " << structures[s].elements
+            << ", \"bytes\": " << structures[s].bytes << "}";
+}
+
+/**
+ * @brief The current sizes, the resident set, the projection and every layer's snapshot as a JSON object.
+ */
+std::string memory::json() {
+    usage now[STRUCTURES];
+    for (int s = 0; s < STRUCTURES; ++s) now[s] = of((structure) s);
+    std::ostringstream out;
+    out << "{";
+    write_structures(out, now);
+    out << ", \"rss_bytes\": " << rss() << ", \"peak_rss_bytes\": " << peak_rss() << ", \"projected_bytes\": " << project()
+        << ", \"layers\": [";
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        out << (i ? ", " : "") << "{\"T\": " << snapshots[i].T << ", ";
+        write_structures(out, snapshots[i].structures);
+        out << ", \"rss_bytes\": " << snapshots[i].rss << ", \"peak_rss_bytes\": " << snapshots[i].peak_rss << "}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+void memory::reset() {
+    for (int s = 0; s < STRUCTURES; ++s) track((structure) s, 0, 0);
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    snapshots.clear();
+}
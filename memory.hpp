@@ -0,0 +1,97 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @file memory.hpp
+ * @brief Bytes and element counts of the large structures of a run, and the process's resident set.
+ *
+ * Each structure is reported through track() by whoever owns it, once its size settles: the packed
+ * layers and generating sets from their record bytes, the layer being built from the arena chunks
+ * it draws on plus the heap its matrices hold, and the pattern set from its node count. A snapshot
+ * is taken at the end of every layer, printed in the layer summary and written to the stats file,
+ * along with the resident set and its peak.
+ *
+ * From the last two BFS layers, project() estimates what the next one will hold, since layers grow
+ * by a roughly constant factor and the working set of the layer being built grows with them.
+ */
+class memory {
+public:
+    enum structure { PRIOR, CURRENT, NEXT, GENERATING_SET, TO_COMPUTE, PATTERN_SET, STRUCTURES };
+    static constexpr size_t SAMPLE = 256;   // Matrices of the layer being built whose heap is measured
+
+    struct usage {
+        uint64_t elements = 0;
+        uint64_t bytes = 0;
+    };
+
+    struct snapshot {
+        int T = 0;
+        usage structures[STRUCTURES];
+        uint64_t rss = 0;
+        uint64_t peak_rss = 0;
+    };
+
+    static void track(const structure s, const uint64_t elements, const uint64_t bytes);
+    static usage of(const structure s);
+    static uint64_t tracked();
+    static uint64_t rss();
+    static uint64_t peak_rss();
+    static snapshot take(const int T);
+    static uint64_t project();
+    static const char *name(const structure s);
+
+    static std::string summary();
+    static std::string json();
+    static void reset();
+
+    /**
+     * @brief Element count and record bytes of a layer or set of layers, summed over its parts.
+     */
+    template <typename Layers>
+    static usage sum(const Layers &parts) {
+        usage u;
+        for (const auto &part : parts) {
+            u.elements += part.size();
+            u.bytes += part.bytes();
+        }
+        return u;
+    }
+
+    /**
+     * @brief Heap bytes held by the matrices of a set, measured on its first SAMPLE matrices and scaled.
+     */
+    template <typename Set>
+    static uint64_t heap_bytes(const Set &matrices) {
+        uint64_t sampled = 0, n = 0;
+        for (auto it = matrices.begin(); it != matrices.end() && n < SAMPLE; ++it, ++n) sampled += it->heap_bytes();
+        return n ? sampled * matrices.size() / n : 0;
+    }
+
+    /**
+     * @brief Estimated bytes of a node of a concurrent skiplist holding T.
+     *
+     * A node holds the value, its height and one pointer per level. Half the nodes reach each next
+     * level, so a node averages two.
+     */
+    template <typename T>
+    static constexpr uint64_t skiplist_node_bytes() {
+        return (sizeof(T) + sizeof(size_t) + 2 * sizeof(void *) + 15) / 16 * 16;
+    }
+
+private:
+    static std::atomic<uint64_t> elements[STRUCTURES];
+    static std::atomic<uint64_t> bytes[STRUCTURES];
+    static std::atomic<uint64_t> highest_rss;     // Largest resident set rss() has read
+
+    static std::mutex snapshot_mutex;       // Guards snapshots
+    static std::vector<snapshot> snapshots;
+};
+
+#endif // MEMORY_HPP
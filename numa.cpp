@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <tbb/info.h>
+#include "numa.hpp"
+
+std::vector<std::unique_ptr<tbb::task_arena>> numa::arenas;
+
+/**
+ * @brief Creates one arena per NUMA node, pinned to that node, and divides the threads among them.
+ *
+ * Threads are split in proportion to the cores of each node. On a machine with a single node, or
+ * when TBB cannot read the topology, this creates one unpinned shard.
+ *
+ * @param threads Total number of threads.
+ */
+void numa::configure(const int threads) {
+    arenas.clear();
+    const std::vector<tbb::numa_node_id> nodes = tbb::info::numa_nodes();
+    int cores = 0;
+    for (const tbb::numa_node_id node : nodes) cores += tbb::info::default_concurrency(node);
+    for (const tbb::numa_node_id node : nodes) {
+        const int share = std::max(1, threads * tbb::info::default_concurrency(node) / std::max(1, cores));
+        arenas.push_back(std::make_unique<tbb::task_arena>(tbb::task_arena::constraints(node, share)));
+    }
+}
+
+/**
+ * @brief Creates shards that are not pinned to any node, dividing the threads evenly.
+ * @param shards Number of shards.
+ * @param threads Total number of threads.
+ */
+void numa::configure_unpinned(const int shards, const int threads) {
+    arenas.clear();
+    for (int k = 0; k < shards; ++k)
+        arenas.push_back(std::make_unique<tbb::task_arena>(std::max(1, threads / shards)));
+}
@@ -0,0 +1,60 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <memory>
+#include <vector>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include "SO6.hpp"
+
+/**
+ * @file numa.hpp
+ * @brief Shards layers and generating sets by NUMA node.
+ *
+ * Each shard owns a task arena whose threads are pinned to one NUMA node, and the data of a shard
+ * is allocated from inside its arena so first-touch places it on that node. Matrices are routed to
+ * shards by their fingerprint, which is invariant under the symmetries SO6 comparison ignores, so
+ * equal matrices always meet in the same shard. Without configure() there is a single shard that
+ * runs in the calling thread's arena.
+ */
+class numa {
+public:
+    static void configure(const int threads);
+    static void configure_unpinned(const int shards, const int threads);
+    static void reset() { arenas.clear(); }
+
+    static size_t shards() { return arenas.empty() ? 1 : arenas.size(); }
+    static bool sharded() { return !arenas.empty(); }
+    static size_t shard_of(const SO6 &S) { return arenas.size() <= 1 ? 0 : S.fingerprint() % arenas.size(); }
+
+    /**
+     * @brief Runs f(shard) for every shard inside that shard's arena and waits for all of them.
+     */
+    template <typename F>
+    static void for_each_shard(F &&f) {
+        if (arenas.empty()) {
+            f(size_t(0));
+            return;
+        }
+        std::vector<tbb::task_group> groups(arenas.size());
+        for (size_t k = 0; k < arenas.size(); ++k)
+            arenas[k]->execute([&, k] { groups[k].run([&, k] { f(k); }); });
+        for (size_t k = 0; k < arenas.size(); ++k)
+            arenas[k]->execute([&, k] { groups[k].wait(); });
+    }
+
+    /**
+     * @brief Copies a container into every shard, allocating each copy on the shard's node.
+     */
+    template <typename C>
+    static std::vector<C> replicate(const C &v) {
+        std::vector<C> copies(shards());
+        for_each_shard([&](const size_t k) { copies[k] = v; });
+        return copies;
+    }
+
+private:
+    static std::vector<std::unique_ptr<tbb::task_arena>> arenas;
+};
+
+#endif // NUMA_HPP
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include "packed_layer.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief Writes the low bits of a value at a bit position, counting from the top bit of the first word.
+ */
+static inline void put_bits(uint64_t *w, const size_t pos, const int bits, const uint64_t value) {
+    const size_t word = pos / 64;
+    const int offset = pos % 64;
+    if (offset + bits <= 64) {
+        w[word] |= value << (64 - offset - bits);
+    } else {
+        const int spill = offset + bits - 64;
+        w[word] |= value >> spill;
+        w[word + 1] |= value << (64 - spill);
+    }
+}
+
+static inline uint64_t get_bits(const uint64_t *w, const size_t pos, const int bits) {
+    const size_t word = pos / 64;
+    const int offset = pos % 64;
+    const uint64_t mask = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+    if (offset + bits <= 64) return (w[word] >> (64 - offset - bits)) & mask;
+    const int spill = offset + bits - 64;
+    return ((w[word] << spill) | (w[word + 1] >> (64 - spill))) & mask;
+}
+
+/**
+ * @brief Bits of a signed field that holds x with an offset of half its range, never encoded as 0.
+ */
+static inline uint8_t signed_bits(const int x) {
+    return std::bit_width((unsigned) std::abs(x)) + 1;
+}
+
+/**
+ * @brief The sign of row r of column c of the canonical matrix, as operator<=> applies it.
+ * @param mask The sign convention, complemented for the columns whose flip bit is set.
+ */
+static inline bool negated(const uint16_t mask, const int r) {
+    return utils::mask_at_index(mask, r) == utils::NEG;
+}
+
+packed_layer::layout packed_layer::layout::of(const SO6 &S) {
+    layout format;
+    for (const Z2 &z : S.arr) {
+        if (z.intPart == 0) continue;
+        format.int_bits = std::max(format.int_bits, signed_bits(z.intPart));
+        format.sqrt2_bits = std::max(format.sqrt2_bits, signed_bits(z.sqrt2Part));
+        format.exponent_bits = std::max(format.exponent_bits, signed_bits(z.exponent));
+    }
+    if (S.hist.size() > 63) throw std::length_error("history of " + std::to_string(S.hist.size()) + " bytes is too long to pack");
+    format.history_bytes = S.hist.size();
+    return format;
+}
+
+packed_layer::layout packed_layer::layout::widest(const layout &other) const {
+    return {std::max(int_bits, other.int_bits), std::max(sqrt2_bits, other.sqrt2_bits),
+            std::max(exponent_bits, other.exponent_bits), std::max(history_bytes, other.history_bytes)};
+}
+
+bool packed_layer::layout::covers(const layout &other) const {
+    return widest(other) == *this;
+}
+
+/**
+ * @brief A layer of count zeroed records, to be filled by set(), possibly from several threads.
+ */
+packed_layer::packed_layer(const layout &format, const size_t count)
+    : shape(format), stride(format.words()), count(count), words(count * stride, 0) {}
+
+/**
+ * @brief Writes the canonical matrix of S in this layer's widths.
+ * @param key Receives the entries, MAX_KEY_WORDS words cleared by the caller.
+ * @param flips Receives a bit for each column whose signs are the complement of the sign convention.
+ * @return false if an entry does not fit.
+ */
+bool packed_layer::encode_key(const SO6 &S, uint64_t *key, uint8_t &flips) const {
+    const int eb = shape.exponent_bits, sb = shape.sqrt2_bits, ib = shape.int_bits, width = shape.entry_bits();
+    const uint64_t ones = (1ULL << width) - 1;
+    flips = 0;
+    for (int c = 0; c < 6; ++c) {
+        uint16_t mask = S.sign_convention;
+        bool leading = true;
+        for (int r = 0; r < 6; ++r) {
+            const Z2 &z = S.arr[S.get_index(S.Row[r], S.Col[c])];
+            uint64_t field = ones;      // Zero sorts after every other entry
+            if (z.intPart != 0) {
+                if (leading && ((z.intPart < 0) ^ negated(mask, r))) {    // The first nonzero entry of a column is positive
+                    mask ^= 0xFFFF;
+                    flips |= 1 << c;
+                }
+                leading = false;
+                const Z2 n = negated(mask, r) ? -z : z;
+                const int a = n.intPart + (1 << (ib - 1)), b = n.sqrt2Part + (1 << (sb - 1)), e = n.exponent + (1 << (eb - 1));
+                if (a <= 0 || a >= (1 << ib) || b <= 0 || b >= (1 << sb) || e <= 0 || e >= (1 << eb)) return false;
+                field = ones ^ ((uint64_t) a << (sb + eb) | (uint64_t) b << eb | (uint64_t) e);   // Larger entries sort first
+            }
+            put_bits(key, (size_t) (6 * c + r) * width, width, field);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Compares the keys of two records, the first KEY_ENTRIES entries.
+ */
+static inline std::strong_ordering compare_keys(const uint64_t *a, const uint64_t *b, const size_t key_bits) {
+    const size_t full = key_bits / 64;
+    for (size_t w = 0; w < full; ++w)
+        if (a[w] != b[w]) return a[w] <=> b[w];
+    const int rest = key_bits % 64;
+    if (rest == 0) return std::strong_ordering::equal;
+    const uint64_t mask = ~0ULL << (64 - rest);
+    return (a[full] & mask) <=> (b[full] & mask);
+}
+
+/**
+ * @brief Packs S into record i. Safe to call for different records from several threads.
+ * @throws std::out_of_range if S is wider than the layer's layout.
+ */
+void packed_layer::set(const size_t i, const SO6 &S) {
+    uint64_t *w = words.data() + i * stride;
+    std::fill(w, w + stride, 0);
+    uint8_t flips;
+    if (!shape.covers(layout::of(S)) || !encode_key(S, w, flips)) throw std::out_of_range("matrix is wider than the layer's packed layout");
+
+    const size_t k = shape.key_words();
+    w[k] = S.fingerprint();
+    uint64_t meta = 0;
+    for (int j = 0; j < 6; ++j) meta |= (uint64_t) S.Row[j] << (3 * j) | (uint64_t) S.Col[j] << (18 + 3 * j);
+    w[k + 1] = meta | (uint64_t) flips << 36 | (uint64_t) S.sign_convention << 42 | (uint64_t) S.hist.size() << 58;
+    w[k + 2] = (uint64_t) S.row_orbit_gates | (uint64_t) S.col_orbit_gates << 15;
+    for (size_t b = 0; b < S.hist.size(); ++b) {
+        const size_t bit = b < 4 ? 30 + 8 * b : 64 + 8 * (b - 4);
+        w[k + 2 + bit / 64] |= (uint64_t) S.hist[b] << (bit % 64);
+    }
+}
+
+/**
+ * @brief Appends S, widening every record first if S needs more bits than the layer's layout.
+ */
+void packed_layer::push_back(const SO6 &S) {
+    const layout needed = layout::of(S);
+    if (!shape.covers(needed)) widen(shape.widest(needed));
+    words.resize((count + 1) * stride, 0);
+    set(count++, S);
+}
+
+/**
+ * @brief Repacks every record in a wider layout.
+ */
+void packed_layer::widen(const layout &format) {
+    packed_layer wider(format, count);
+    for (size_t i = 0; i < count; ++i) wider.set(i, matrix(i));
+    swap(wider);
+}
+
+/**
+ * @brief Rebuilds record i without its frequency maps.
+ *
+ * The result can be multiplied, transposed, compared, fingerprinted and written, but canonical_form()
+ * and left multiplying by T matrices need the working matrix from operator[].
+ */
+SO6 packed_layer::matrix(const size_t i) const {
+    SO6 S;
+    matrix(i, S);
+    return S;
+}
+
+/**
+ * @brief Rebuilds record i into S, overwriting all but its frequency maps, which S must not rely on.
+ *
+ * Products unpack every generator into one matrix, which is much cheaper than constructing a new one each time.
+ */
+void packed_layer::matrix(const size_t i, SO6 &S) const {
+    const uint64_t *w = words.data() + i * stride;
+    const size_t k = shape.key_words();
+    const uint64_t meta = w[k + 1];
+    for (int j = 0; j < 6; ++j) {
+        S.Row[j] = meta >> (3 * j) & 7;
+        S.Col[j] = meta >> (18 + 3 * j) & 7;
+    }
+    const uint8_t flips = meta >> 36 & 0x3F;
+    S.sign_convention = meta >> 42 & 0xFFFF;
+    S.row_orbit_gates = w[k + 2] & 0x7FFF;
+    S.col_orbit_gates = w[k + 2] >> 15 & 0x7FFF;
+    S.hist.resize(meta >> 58);
+    for (size_t b = 0; b < S.hist.size(); ++b) {
+        const size_t bit = b < 4 ? 30 + 8 * b : 64 + 8 * (b - 4);
+        S.hist[b] = w[k + 2 + bit / 64] >> (bit % 64) & 0xFF;
+    }
+    S.pattern_valid = false;
+
+    const int eb = shape.exponent_bits, sb = shape.sqrt2_bits, ib = shape.int_bits, width = shape.entry_bits();
+    const uint64_t ones = (1ULL << width) - 1;
+    for (int c = 0; c < 6; ++c) {
+        const uint16_t mask = (flips >> c & 1) ? S.sign_convention ^ 0xFFFF : S.sign_convention;
+        for (int r = 0; r < 6; ++r) {
+            const uint64_t field = ones ^ get_bits(w, (size_t) (6 * c + r) * width, width);
+            Z2 &z = S.arr[S.get_index(S.Row[r], S.Col[c])];
+            if (field == 0) {
+                z.intPart = z.sqrt2Part = z.exponent = 0;
+                continue;
+            }
+            const int sign = negated(mask, r) ? -1 : 1;     // Fields are written in place, this runs once per product
+            z.intPart = sign * ((int) (field >> (sb + eb)) - (1 << (ib - 1)));
+            z.sqrt2Part = sign * ((int) (field >> eb & ((1 << sb) - 1)) - (1 << (sb - 1)));
+            z.exponent = (int) (field & ((1 << eb) - 1)) - (1 << (eb - 1));
+        }
+    }
+}
+
+/**
+ * @brief Rebuilds record i as a working matrix, exactly as it was packed.
+ */
+SO6 packed_layer::operator[](const size_t i) const {
+    SO6 S = matrix(i);
+    for (int col = 0; col < 6; ++col)
+        for (int row = 0; row < 6; ++row) {
+            const Z2 z = S.arr[S.get_index(row, col)].abs();
+            S.row_frequency[row][z]++;
+            S.col_frequency[col][z]++;
+        }
+    return S;
+}
+
+/**
+ * @brief Compares record i with S as operator<=> compares the matrices.
+ */
+std::strong_ordering packed_layer::compare(const size_t i, const SO6 &S) const {
+    uint64_t key[MAX_KEY_WORDS] = {};
+    uint8_t flips;
+    if (!encode_key(S, key, flips)) return matrix(i) <=> S;
+    return compare_keys(words.data() + i * stride, key, KEY_ENTRIES * shape.entry_bits());
+}
+
+/**
+ * @brief Searches a sorted layer for the class of S by bisection on the packed keys.
+ */
+bool packed_layer::contains(const SO6 &S) const {
+    uint64_t key[MAX_KEY_WORDS] = {};
+    uint8_t flips;
+    if (count == 0 || !encode_key(S, key, flips)) return false;     // Wider than every matrix of the layer
+    const size_t key_bits = KEY_ENTRIES * shape.entry_bits();
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const std::strong_ordering order = compare_keys(words.data() + mid * stride, key, key_bits);
+        if (order == 0) return true;
+        if (order < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+void packed_layer::swap(packed_layer &other) noexcept {
+    std::swap(shape, other.shape);
+    std::swap(stride, other.stride);
+    std::swap(count, other.count);
+    words.swap(other.words);
+}
+
+/**
+ * @brief Shuffles the records in place.
+ */
+void packed_layer::shuffle(std::mt19937 &g) {
+    for (size_t i = count; i > 1; --i) {
+        const size_t j = std::uniform_int_distribution<size_t>(0, i - 1)(g);
+        std::swap_ranges(words.begin() + (i - 1) * stride, words.begin() + i * stride, words.begin() + j * stride);
+    }
+}
+
+/**
+ * @brief Sorts the records as operator<=> orders their matrices.
+ */
+void packed_layer::sort() {
+    const size_t key_bits = KEY_ENTRIES * shape.entry_bits();
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+        return compare_keys(words.data() + a * stride, words.data() + b * stride, key_bits) < 0;
+    });
+    std::vector<uint64_t> sorted(words.size());
+    for (size_t i = 0; i < count; ++i) std::copy_n(words.begin() + order[i] * stride, stride, sorted.begin() + i * stride);
+    words.swap(sorted);
+}
@@ -0,0 +1,122 @@
+#ifndef PACKED_LAYER_HPP
+#define PACKED_LAYER_HPP
+
+#include <compare>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <vector>
+#include "SO6.hpp"
+
+/**
+ * @file packed_layer.hpp
+ * @brief Layers of matrices stored as bit-packed records.
+ *
+ * A working SO6 holds its entries, twelve frequency maps, its history and its canonical form, most
+ * of it on the heap. A stored layer only needs enough to rebuild it, so each matrix is kept as one
+ * fixed-size record of 64-bit words:
+ *
+ *  - the canonical matrix, the entries in the order and with the signs operator<=> compares them,
+ *    each field of an entry in as few bits as the layer's widest value needs,
+ *  - the fingerprint,
+ *  - the row and column permutations, the sign convention and the column signs that undo the
+ *    canonical order, so the entries come back exactly as the product of the history,
+ *  - the orbit masks canonical_form() found, and the packed history.
+ *
+ * Entries are encoded so that comparing the words of two records as unsigned integers orders them
+ * as operator<=> orders the matrices, so a sorted layer is searched without rebuilding any matrix.
+ * A layer's widths grow with the T count, since entries gain a power of sqrt(2) in the denominator
+ * and bits in the numerator per T matrix, and are widened as wider matrices are added.
+ */
+class packed_layer {
+public:
+    static constexpr int ENTRIES = 36;
+    static constexpr int KEY_ENTRIES = 30;      // operator<=> only compares the first five columns
+    static constexpr int MAX_KEY_WORDS = 16;    // Entries of 9 bit fields, the widest an 8 bit Z2 needs
+
+    /**
+     * @brief The widths of a layer's records.
+     */
+    struct layout {
+        uint8_t int_bits = 1;           // Bits of an entry's integer part
+        uint8_t sqrt2_bits = 1;         // Bits of its sqrt(2) part
+        uint8_t exponent_bits = 1;      // Bits of its exponent
+        uint8_t history_bytes = 0;      // Bytes of packed history
+
+        static layout of(const SO6 &S);
+        layout widest(const layout &other) const;
+        bool covers(const layout &other) const;
+        int entry_bits() const { return int_bits + sqrt2_bits + exponent_bits; }
+        size_t key_words() const { return (ENTRIES * entry_bits() + 63) / 64; }
+        size_t words() const { return key_words() + 3 + (history_bytes > 4 ? (history_bytes - 4 + 7) / 8 : 0); }
+        bool operator==(const layout &) const = default;
+    };
+
+    /**
+     * @brief Input iterator that rebuilds each working matrix as it is read.
+     */
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = SO6;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = SO6;
+
+        iterator(const packed_layer *layer, size_t index) : layer(layer), index(index) {}
+        SO6 operator*() const { return (*layer)[index]; }
+        iterator &operator++() { ++index; return *this; }
+        iterator operator++(int) { iterator old = *this; ++index; return old; }
+        bool operator==(const iterator &other) const { return index == other.index; }
+        difference_type operator-(const iterator &other) const { return (difference_type) index - (difference_type) other.index; }
+
+    private:
+        const packed_layer *layer;
+        size_t index;
+    };
+
+    packed_layer() = default;
+    packed_layer(const layout &format, const size_t count);
+    template <typename It>
+    packed_layer(It first, It last) {
+        layout format;
+        for (It it = first; it != last; ++it) format = format.widest(layout::of(*it));
+        *this = packed_layer(format, 0);
+        reserve(std::distance(first, last));
+        for (It it = first; it != last; ++it) push_back(*it);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t bytes() const { return words.capacity() * sizeof(uint64_t); }
+    size_t record_bytes() const { return stride * sizeof(uint64_t); }
+    const layout &format() const { return shape; }
+
+    SO6 operator[](const size_t i) const;
+    SO6 matrix(const size_t i) const;
+    void matrix(const size_t i, SO6 &S) const;
+    uint64_t fingerprint(const size_t i) const { return words[i * stride + shape.key_words()]; }
+    std::strong_ordering compare(const size_t i, const SO6 &S) const;
+    bool contains(const SO6 &S) const;
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, count); }
+
+    void set(const size_t i, const SO6 &S);
+    void push_back(const SO6 &S);
+    void reserve(const size_t n) { words.reserve(n * stride); }
+    void clear() { std::vector<uint64_t>().swap(words); count = 0; }
+    void swap(packed_layer &other) noexcept;
+    void shuffle(std::mt19937 &g);
+    void sort();
+
+private:
+    layout shape;
+    size_t stride = layout().words();
+    size_t count = 0;
+    std::vector<uint64_t> words;
+
+    bool encode_key(const SO6 &S, uint64_t *key, uint8_t &flips) const;
+    void widen(const layout &format);
+};
+
+#endif // PACKED_LAYER_HPP
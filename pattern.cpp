@@ -168,45 +168,108 @@ const uint8_t pattern::column_weight(const int col) const {
  */
 const uint8_t pattern::case_num() const {
     if(case_num_memo != 0xFF) return case_num_memo;
+    return (case_num_memo = classify(pattern_data.low_bits, pattern_data.high_bits));
+}
 
-    const int hamming_weight = (pattern_data & int_part).popcount();
+/**
+ * @brief Gathers the integer bits of a pattern into a 36 bit word, entry (row, col) at bit 6*col + row.
+ */
+static inline uint64_t compact_int_bits(const uint64_t low_bits, const uint64_t high_bits) {
+    uint64_t x = (low_bits >> 1) & 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+    uint64_t h = (high_bits >> 1) & 0x55;
+    h = (h | (h >> 1)) & 0x33;
+    h = (h | (h >> 2)) & 0x0F;
+    return x | (h << 32);
+}
 
-    switch (hamming_weight) {
-        case 4: return (case_num_memo = 1);
-        case 24: return (case_num_memo = 8);
-        case 16: {
-            for(int col = 0; col < 3; col++) if (get_masked_col(col).popcount() == 2) return (case_num_memo = 6);
-            for(int row = 0; row < 3; row++) if (get_masked_row(row).popcount() == 2) return (case_num_memo = 6);
-            return (case_num_memo = 3);
-        }
-        case 12: {
-            for(int col = 0; col < 3; col++) {
-                int num_ones = get_masked_col(col).popcount();
-                if(num_ones == 4 || num_ones == 0) return (case_num_memo = 4);
-            }
-            return (case_num_memo = 7);
-        }
-        case 8: {
-            int zero_cols = 0;
-            for(int col = 0; col < 4; col++) {          
-                int num_ones = get_masked_col(col).popcount();
-                if(num_ones == 4) return (case_num_memo = 2);
-                else if(num_ones == 0) zero_cols++;
-                if(zero_cols > 2) return (case_num_memo = 2);
-            }
-            
-            int zero_rows = 0;
-            for(int row = 0; row < 4; row++) {
-                int num_ones = get_masked_row(row).popcount();
-                if(num_ones == 4) return (case_num_memo = 2);
-                else if(num_ones == 0) zero_rows++;
-                if(zero_rows > 2) return (case_num_memo = 2);
-            }
-
-            return (case_num_memo = 5);
-        }
-        default: return (case_num_memo = 0);  // This will hit when we hit the identity case
+/**
+ * @brief Spreads the 4 low bits of x into the low bit of 4 nibbles.
+ */
+static inline uint64_t spread_nibbles(uint64_t x) {
+    x &= 0xF;
+    x = (x | (x << 6)) & 0x0303;
+    return (x | (x << 3)) & 0x1111;
+}
+
+/**
+ * @brief Branch-free case number of the pattern with the given data, see case_num().
+ *
+ * Only shifts, masks, adds and selects are used, so loops over this function vectorize. Column
+ * weights are summed two bits at a time inside each 6 bit column of the compacted integer bits.
+ * Row weights of rows 0-3, the only rows case_num() inspects, are summed one nibble per row.
+ */
+inline uint8_t pattern::classify(const uint64_t low_bits, const uint64_t high_bits) {
+    const uint64_t c = compact_int_bits(low_bits, high_bits);
+
+    constexpr uint64_t PAIR_LOW = 0x555555555ULL;       // Low bit of every bit pair
+    constexpr uint64_t FIELD_PAIR = 0x0C30C30C3ULL;     // Lowest pair of every 6 bit column
+    const uint64_t pairs = c - ((c >> 1) & PAIR_LOW);
+    const uint64_t col_weights = (pairs & FIELD_PAIR) + ((pairs >> 2) & FIELD_PAIR) + ((pairs >> 4) & FIELD_PAIR);
+
+    uint64_t row_weights = 0;
+    for (int col = 0; col < 6; ++col) row_weights += spread_nibbles(c >> (6 * col));
+
+    int col_w[4], row_w[4];
+    int hamming_weight = 0;
+    for (int k = 0; k < 6; ++k) hamming_weight += (col_weights >> (6 * k)) & 7;
+    for (int k = 0; k < 4; ++k) {
+        col_w[k] = (col_weights >> (6 * k)) & 7;
+        row_w[k] = (row_weights >> (4 * k)) & 0xF;
+    }
+
+    const bool two_in_first_3 = (col_w[0] == 2) | (col_w[1] == 2) | (col_w[2] == 2) | (row_w[0] == 2) | (row_w[1] == 2) | (row_w[2] == 2);
+    const bool full_or_empty_col = (col_w[0] == 4) | (col_w[1] == 4) | (col_w[2] == 4) | (col_w[0] == 0) | (col_w[1] == 0) | (col_w[2] == 0);
+    const int zero_cols = (col_w[0] == 0) + (col_w[1] == 0) + (col_w[2] == 0) + (col_w[3] == 0);
+    const int zero_rows = (row_w[0] == 0) + (row_w[1] == 0) + (row_w[2] == 0) + (row_w[3] == 0);
+    const bool weight_8_split = (col_w[0] == 4) | (col_w[1] == 4) | (col_w[2] == 4) | (col_w[3] == 4) |
+                                (row_w[0] == 4) | (row_w[1] == 4) | (row_w[2] == 4) | (row_w[3] == 4) |
+                                (zero_cols > 2) | (zero_rows > 2);
+
+    uint8_t ret = 0;   // Any other weight, e.g. the identity
+    ret = hamming_weight == 4 ? 1 : ret;
+    ret = hamming_weight == 24 ? 8 : ret;
+    ret = hamming_weight == 16 ? (two_in_first_3 ? 6 : 3) : ret;
+    ret = hamming_weight == 12 ? (full_or_empty_col ? 4 : 7) : ret;
+    ret = hamming_weight == 8 ? (weight_8_split ? 2 : 5) : ret;
+    return ret;
+}
+
+/**
+ * @brief Computes the case numbers of a whole buffer of pattern data at once.
+ * @param data Pattern data to classify.
+ * @param n Number of patterns.
+ * @param cases Output, cases[i] receives the case number of data[i].
+ */
+void pattern::case_nums(const uint72_t *data, const size_t n, uint8_t *cases) {
+    #pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        cases[i] = classify(data[i].low_bits, data[i].high_bits);
+    }
+}
+
+/**
+ * @brief Checks that the pattern could come from an orthogonal matrix.
+ *
+ * Scaling a row (or column) of unit norm by a nonzero LDE and reducing mod 2 shows that it holds an
+ * even number of entries at the LDE, so every row and column has an even number of integer bits.
+ * At LDE 0 the matrix is a signed permutation and every row and column has exactly one.
+ *
+ * @return true if the row and column integer bit counts are all even, or all exactly one.
+ */
+const bool pattern::is_well_formed() const {
+    bool even = true, permutation = true;
+    for (int k = 0; k < 6; ++k) {
+        const int row_ones = get_masked_row(k).popcount();
+        const int col_ones = get_masked_col(k).popcount();
+        even &= !(row_ones & 1) && !(col_ones & 1);
+        permutation &= (row_ones == 1) && (col_ones == 1);
     }
+    return even || permutation;
 }
 
 const std::strong_ordering pattern::operator<=>(const pattern &other) const
@@ -219,28 +282,79 @@ const std::strong_ordering pattern::operator<=>(const pattern &other) const
     return result;
 }
 
-/// @brief 
-/// @return 
+const std::array<uint72_t, 64> pattern::row_set_int_masks = pattern::make_row_set_int_masks();
+
+/**
+ * @brief Returns a copy of the pattern with every row modded.
+ *
+ * Every cell whose integer bit is set has its sqrt(2) bit toggled. Since the integer bit of a
+ * cell sits directly above its sqrt(2) bit, this is a single masked XOR over the packed data.
+ *
+ * @return The modded pattern.
+ */
 pattern pattern::pattern_mod() {
     pattern ret = *this;
-    for (int col = 0; col < 6; col++) {
-        for(int row = 0; row < 6; row++) {
-            uint8_t value = ret.get_val(row,col);
-            if(value < 2) continue;
-            ret.set(row, col, value^1);
-        }
-    }
+    ret.pattern_data = ret.pattern_data ^ ((ret.pattern_data & int_part) >> 1);
     return ret;
 }
 
+/**
+ * @brief Mods a single row of the pattern in place.
+ * @param r The row to mod.
+ */
 void pattern::mod_row(const int r) {
-    int row = r;
-    for (int col = 0; col < 6; col++) {
-        auto value = get_val(row,col);
-        if(value < 2) continue;
-        value ^=1;
-        set(row,col,value);
+    mod_rows(1 << r);
+}
+
+/**
+ * @brief Mods every row whose bit is set in the given row mask with a single masked XOR.
+ * @param rows Bitmask of rows to mod, bit r selecting row r.
+ */
+void pattern::mod_rows(const uint8_t rows) {
+    pattern_data = pattern_data ^ ((pattern_data & row_set_int_masks[rows & 0x3F]) >> 1);
+}
+
+/**
+ * @brief Permutes the rows of the pattern so that row r of the result is row perm[r] of this.
+ *
+ * Rows occupy a fixed 2-bit slot at the same offset in every 12-bit column, so each source row
+ * is moved to its destination by one mask and one shift on the 128-bit packing of the data.
+ *
+ * @param perm The row permutation.
+ * @return The permuted pattern.
+ */
+pattern pattern::permute_rows(const int perm[6]) const {
+    const unsigned __int128 data = pattern_data.as_uint128();
+    unsigned __int128 ret = 0;
+    for (int r = 0; r < 6; ++r) {
+        const int shift = (r - perm[r]) << 1;
+        const unsigned __int128 src = data & row_masks_128[perm[r]];
+        ret |= shift >= 0 ? src << shift : src >> -shift;
+    }
+    pattern p;
+    p.pattern_data = uint72_t::from_uint128(ret);
+    return p;
+}
+
+/**
+ * @brief Permutes the columns of the pattern so that column c of the result is column perm[c] of this.
+ *
+ * Each column is a contiguous 12-bit block, so every column moves with a single mask and shift.
+ *
+ * @param perm The column permutation.
+ * @return The permuted pattern.
+ */
+pattern pattern::permute_cols(const int perm[6]) const {
+    const unsigned __int128 data = pattern_data.as_uint128();
+    unsigned __int128 ret = 0;
+    for (int c = 0; c < 6; ++c) {
+        const int shift = (c - perm[c]) * 12;
+        const unsigned __int128 src = data & col_masks_128[perm[c]];
+        ret |= shift >= 0 ? src << shift : src >> -shift;
     }
+    pattern p;
+    p.pattern_data = uint72_t::from_uint128(ret);
+    return p;
 }
 
 /**
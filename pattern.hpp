@@ -2,6 +2,7 @@
 #define PATTERN_HPP
 
 #include <iostream>
+#include <array>
 #include <functional> // For std::hash
 #include "SO6.hpp"
 #include "uint72_t.hpp" // uint72_t for data
@@ -17,7 +18,12 @@ class pattern{
 
         void operator=(const pattern &);
         void mod_row(const int);
+        void mod_rows(const uint8_t);
         pattern pattern_mod();
+
+        // Bit-sliced transforms: result(r,c) = this(perm[r],c) and this(r,perm[c]) respectively
+        pattern permute_rows(const int[6]) const;
+        pattern permute_cols(const int[6]) const;
         
         // Output
         friend std::ostream& operator<<(std::ostream&, const pattern &);
@@ -33,6 +39,11 @@ class pattern{
         // Constants
         static const pattern identity() {return pattern(0x4000040010001, 0x40);}
 
+        // Bit layout, for building and patching packed patterns outside the class
+        static constexpr int cell_position(const int row, const int col) {return (col<<3) + (col<<2) + (row<<1);}
+        static constexpr uint72_t int_bits() {return int_part;}
+        static uint72_t row_set_mask(const uint8_t rows) {return row_set_int_masks[rows & 0x3F] | (row_set_int_masks[rows & 0x3F] >> 1);}
+
         // Setters
         void set(const int bit_position, const bool& value);
         void set(const int row, const int col, const uint8_t value);
@@ -40,12 +51,15 @@ class pattern{
 
         // Getters
         const uint8_t case_num() const;
+        const bool is_well_formed() const;
+        static void case_nums(const uint72_t *, const size_t, uint8_t *);
         const uint16_t get_column(const int) const;
         std::pair<bool, bool> get(const int row, const int col) const;
         std::uint8_t get_val(const int row, const int col) const;
 
     private:
         mutable uint8_t case_num_memo = 0xFF;
+        static uint8_t classify(const uint64_t, const uint64_t);
 
         // Various masks for rows/columns
         constexpr static uint72_t row_0 = uint72_t(0x3003003003003003,0x00);
@@ -65,6 +79,25 @@ class pattern{
         constexpr static uint72_t int_part     = uint72_t(0xAAAAAAAAAAAAAAAAULL, 0xAA);
         constexpr static uint72_t sqrt2_part   = uint72_t(0x5555555555555555ULL, 0x55);
 
+        // Int-part masks for every subset of rows, indexed by the row bitmask passed to mod_rows
+        constexpr static std::array<uint72_t, 64> make_row_set_int_masks() {
+            constexpr uint72_t rows[6] = {row_0, row_1, row_2, row_3, row_4, row_5};
+            std::array<uint72_t, 64> ret{};
+            for (int set = 0; set < 64; ++set) {
+                uint72_t mask(0, 0);
+                for (int r = 0; r < 6; ++r) if ((set >> r) & 1) mask = mask | rows[r];
+                ret[set] = mask & int_part;
+            }
+            return ret;
+        }
+        static const std::array<uint72_t, 64> row_set_int_masks;
+
+        // Row and column masks packed into a 128-bit register for permute_rows/permute_cols
+        constexpr static unsigned __int128 row_masks_128[6] = {row_0.as_uint128(), row_1.as_uint128(), row_2.as_uint128(),
+                                                               row_3.as_uint128(), row_4.as_uint128(), row_5.as_uint128()};
+        constexpr static unsigned __int128 col_masks_128[6] = {col_0.as_uint128(), col_1.as_uint128(), col_2.as_uint128(),
+                                                               col_3.as_uint128(), col_4.as_uint128(), col_5.as_uint128()};
+
         // Helper function to compute the bit position
         constexpr inline int bit_position(const int row, const int col) const { return ((col<<3) + (col<<2)  + (row<<1)); }
 
@@ -0,0 +1,234 @@
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+#include "pattern_io.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief Checks whether a file starts with the binary pattern header.
+ * @param path Path of the pattern file.
+ * @return true if the file is a binary pattern file.
+ */
+bool pattern_io::is_binary(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4] = {0, 0, 0, 0};
+    file.read(magic, 4);
+    return file.gcount() == 4 && std::memcmp(magic, MAGIC, 4) == 0;
+}
+
+/**
+ * @brief Parses one line of a text pattern file.
+ * @param line A 72 character binary string or 36 comma separated entries in 0-3.
+ * @return The parsed pattern.
+ * @throws std::invalid_argument if the line is in neither format.
+ */
+pattern pattern_io::parse_line(const std::string &line) {
+    std::string trimmed = line;
+    while (!trimmed.empty() && std::isspace(static_cast<unsigned char>(trimmed.back()))) trimmed.pop_back();
+
+    if (trimmed.find(',') != std::string::npos) return pattern(utils::convert_csv_line_to_binary(trimmed));
+
+    if (trimmed.length() != 72) throw std::invalid_argument("expected 72 binary digits, found " + std::to_string(trimmed.length()) + " characters");
+    if (trimmed.find_first_not_of("01") != std::string::npos) throw std::invalid_argument("non-binary character in pattern");
+    return pattern(trimmed);
+}
+
+/**
+ * @brief Writes a pattern as a 9 byte record.
+ * @param p The pattern.
+ * @param record Destination of at least RECORD_SIZE bytes.
+ */
+void pattern_io::encode(const pattern &p, unsigned char *record) {
+    for (int i = 0; i < 8; ++i) record[i] = static_cast<unsigned char>(p.pattern_data.low_bits >> (i << 3));
+    record[8] = p.pattern_data.high_bits;
+}
+
+/**
+ * @brief Reads a pattern from a 9 byte record.
+ * @param record Source of at least RECORD_SIZE bytes.
+ * @return The pattern.
+ */
+pattern pattern_io::decode(const unsigned char *record) {
+    uint64_t low_bits = 0;
+    for (int i = 0; i < 8; ++i) low_bits |= static_cast<uint64_t>(record[i]) << (i << 3);
+    return pattern(low_bits, record[8]);
+}
+
+/**
+ * @brief Reads a text pattern file, skipping malformed lines.
+ * @param path Path of the pattern file.
+ * @param targets Set receiving every well-formed non-identity pattern.
+ * @return Load statistics.
+ */
+pattern_io::load_result pattern_io::read_text(const std::string &path, tbb::concurrent_set<pattern> &targets) {
+    load_result result;
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open pattern file: " << path << std::endl;
+        return result;
+    }
+
+    std::string line;
+    uint64_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        if (line.empty() || line == "\r") continue;
+        try {
+            pattern p = parse_line(line);
+            if (!p.is_well_formed()) throw std::invalid_argument("odd number of integer bits in a row or column");
+            ++result.read;
+            if (p.case_num() == 0) continue;
+            targets.insert(p);
+            ++result.inserted;
+        } catch (const std::exception &e) {
+            ++result.malformed;
+            std::cerr << "[Read] Skipping malformed line " << line_number << ": " << e.what() << std::endl;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Reads a binary pattern file in parallel.
+ *
+ * The file is memory mapped and split into chunks of records. Each thread decodes a chunk,
+ * classifies it with one batch case_nums() call, then validates and inserts its patterns directly
+ * into the concurrent target set.
+ *
+ * @param path Path of the pattern file.
+ * @param targets Set receiving every well-formed non-identity pattern.
+ * @param threads Number of threads to use.
+ * @return Load statistics.
+ */
+pattern_io::load_result pattern_io::read_binary(const std::string &path, tbb::concurrent_set<pattern> &targets, const int threads) {
+    load_result result;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open pattern file: " << path << std::endl;
+        return result;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < HEADER_SIZE) {
+        std::cerr << "Pattern file too short for a header: " << path << std::endl;
+        close(fd);
+        return result;
+    }
+
+    const size_t size = st.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Failed to map pattern file: " << path << std::endl;
+        return result;
+    }
+    const unsigned char *data = static_cast<const unsigned char *>(mapped);
+
+    // Header: magic, version and record size (little endian u16), record count (little endian u64)
+    uint16_t version = data[4] | (data[5] << 8);
+    uint16_t record_size = data[6] | (data[7] << 8);
+    uint64_t count = 0;
+    for (int i = 0; i < 8; ++i) count |= static_cast<uint64_t>(data[8 + i]) << (i << 3);
+
+    if (std::memcmp(data, MAGIC, 4) != 0 || version != VERSION || record_size != RECORD_SIZE
+        || count > (size - HEADER_SIZE) / RECORD_SIZE || HEADER_SIZE + count * RECORD_SIZE != size) {     // Bounded first, so the product cannot wrap
+        std::cerr << "Invalid binary pattern file header: " << path << std::endl;
+        munmap(mapped, size);
+        return result;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    const unsigned char *records = data + HEADER_SIZE;
+    const int64_t chunk_size = 1 << 16;
+    const int64_t chunks = (count + chunk_size - 1) / chunk_size;
+    uint64_t read = 0, inserted = 0, malformed = 0;
+
+    #pragma omp parallel num_threads(threads) reduction(+:read,inserted,malformed)
+    {
+        std::vector<uint72_t> chunk_data(chunk_size);
+        std::vector<uint8_t> cases(chunk_size);
+
+        #pragma omp for schedule(dynamic)
+        for (int64_t chunk = 0; chunk < chunks; ++chunk) {
+            const uint64_t begin = chunk * chunk_size;
+            const uint64_t n = std::min<uint64_t>(count, begin + chunk_size) - begin;
+            for (uint64_t i = 0; i < n; ++i) chunk_data[i] = decode(records + (begin + i) * RECORD_SIZE).pattern_data;
+            pattern::case_nums(chunk_data.data(), n, cases.data());
+
+            for (uint64_t i = 0; i < n; ++i) {
+                pattern p(chunk_data[i].low_bits, chunk_data[i].high_bits);
+                if (!p.is_well_formed()) {
+                    ++malformed;
+                    continue;
+                }
+                ++read;
+                if (cases[i] == 0) continue;
+                targets.insert(p);
+                ++inserted;
+            }
+        }
+    }
+    munmap(mapped, size);
+
+    result.read = read;
+    result.inserted = inserted;
+    result.malformed = malformed;
+    if (malformed) std::cerr << "[Read] Skipped " << malformed << " malformed records in " << path << std::endl;
+    return result;
+}
+
+/**
+ * @brief Converts a text or CSV pattern file to the binary format, skipping malformed lines.
+ * @param text_path Path of the text pattern file.
+ * @param binary_path Path of the binary file to write.
+ * @return Conversion statistics, with inserted counting the records written.
+ */
+pattern_io::load_result pattern_io::convert(const std::string &text_path, const std::string &binary_path) {
+    load_result result;
+    std::ifstream in(text_path);
+    if (!in.is_open()) {
+        std::cerr << "Failed to open pattern file: " << text_path << std::endl;
+        return result;
+    }
+    std::ofstream out(binary_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file: " << binary_path << std::endl;
+        return result;
+    }
+
+    unsigned char header[HEADER_SIZE] = {0};
+    out.write(reinterpret_cast<const char *>(header), HEADER_SIZE);     // Count is patched in once known
+
+    std::string line;
+    uint64_t line_number = 0;
+    unsigned char record[RECORD_SIZE];
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (line.empty() || line == "\r") continue;
+        try {
+            pattern p = parse_line(line);
+            if (!p.is_well_formed()) throw std::invalid_argument("odd number of integer bits in a row or column");
+            ++result.read;
+            encode(p, record);
+            out.write(reinterpret_cast<const char *>(record), RECORD_SIZE);
+            ++result.inserted;
+        } catch (const std::exception &e) {
+            ++result.malformed;
+            std::cerr << "[Convert] Skipping malformed line " << line_number << ": " << e.what() << std::endl;
+        }
+    }
+
+    std::memcpy(header, MAGIC, 4);
+    header[4] = VERSION & 0xFF;
+    header[5] = VERSION >> 8;
+    header[6] = RECORD_SIZE & 0xFF;
+    header[7] = RECORD_SIZE >> 8;
+    for (int i = 0; i < 8; ++i) header[8 + i] = static_cast<unsigned char>(result.inserted >> (i << 3));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(header), HEADER_SIZE);
+    return result;
+}
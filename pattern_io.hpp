@@ -0,0 +1,45 @@
+#ifndef PATTERN_IO_HPP
+#define PATTERN_IO_HPP
+
+#include <string>
+#include <tbb/concurrent_set.h>
+#include "pattern.hpp"
+
+/**
+ * @file pattern_io.hpp
+ * @brief Reading and writing pattern files.
+ *
+ * Two on-disk formats are supported:
+ * - Text: one pattern per line, either a 72 character binary string (two bits per entry, column
+ *   major) or 36 comma separated entries in 0-3.
+ * - Binary: a 16 byte header followed by 9 bytes per pattern, the low 64 bits of the pattern data
+ *   in little endian order and then the high 8 bits.
+ */
+class pattern_io {
+public:
+    static constexpr char MAGIC[4] = {'E', 'S', 'P', 'B'};
+    static constexpr uint16_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 16;
+    static constexpr size_t RECORD_SIZE = 9;
+
+    /**
+     * @brief Load statistics for a pattern file.
+     */
+    struct load_result {
+        uint64_t read = 0;          // Patterns parsed
+        uint64_t inserted = 0;      // Non-identity patterns passed to the target set
+        uint64_t malformed = 0;     // Lines or records rejected
+    };
+
+    static bool is_binary(const std::string &path);
+    static pattern parse_line(const std::string &line);
+
+    static load_result read_text(const std::string &path, tbb::concurrent_set<pattern> &targets);
+    static load_result read_binary(const std::string &path, tbb::concurrent_set<pattern> &targets, const int threads);
+    static load_result convert(const std::string &text_path, const std::string &binary_path);
+
+    static void encode(const pattern &p, unsigned char *record);
+    static pattern decode(const unsigned char *record);
+};
+
+#endif // PATTERN_IO_HPP
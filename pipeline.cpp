@@ -0,0 +1,176 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <tbb/flow_graph.h>
+#include "bfs.hpp"
+#include "coverage.hpp"
+#include "pipeline.hpp"
+#include "run_stats.hpp"
+#include "symmetry.hpp"
+
+bool pipeline::active = false;
+int pipeline::allocation[pipeline::STAGES] = {1, 1, 1, 1};
+pipeline::stage_stats pipeline::counters[pipeline::STAGES];
+
+static const char *stage_names[pipeline::STAGES] = {"expand", "dedup", "pattern", "write"};
+
+/**
+ * @brief Enables the pipeline and sets the threads of each stage.
+ * @param spec "auto", or the threads of the expand, dedup and pattern stages as "e,d,p". The write stage always has one.
+ * @param threads Total number of threads, used by "auto".
+ * @throws std::invalid_argument if spec is in neither form.
+ */
+void pipeline::configure(const std::string &spec, const int threads) {
+    if (spec == "auto") {
+        allocation[EXPAND] = threads;                   // Canonicalization dominates, let it use every thread
+        allocation[DEDUP] = std::max(1, threads / 4);
+        allocation[PATTERN] = std::max(1, threads / 4);
+    } else {
+        std::stringstream ss(spec);
+        std::string item;
+        int s = EXPAND;
+        while (std::getline(ss, item, ',')) {
+            if (s == WRITE) throw std::invalid_argument("expected 3 stage thread counts in " + spec);
+            allocation[s++] = std::max(1, std::stoi(item));
+        }
+        if (s != WRITE) throw std::invalid_argument("expected 3 stage thread counts in " + spec);
+    }
+    allocation[WRITE] = 1;
+    active = true;
+}
+
+/**
+ * @brief Times a stage body and adds it to the stage's counters.
+ */
+template <typename F>
+static auto timed(pipeline::stage_stats &stats, const size_t items_in, F &&body) {
+    auto start = std::chrono::steady_clock::now();
+    auto out = body();
+    stats.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    stats.batches++;
+    stats.items_in += items_in;
+    stats.items_out += out->size();
+    return out;
+}
+
+/**
+ * @brief Expands one layer through the staged pipeline.
+ * @param frontier The current layer, sorted.
+ * @param prior The previous layer, sorted.
+ * @param next Receives the children not in prior.
+ * @param select Called for new children whose case is still a target; returns true to record the child.
+ * @param record Called one child at a time for every selected child.
+ */
+void pipeline::expand(const packed_layer &frontier, const packed_layer &prior, bfs::node_set &next,
+                      const std::function<bool(SO6 &)> &select, const std::function<void(SO6 &)> &record) {
+    using range = std::pair<size_t, size_t>;
+    using batch = std::shared_ptr<std::vector<SO6>>;    // Shared so batches move between stages without copying matrices
+    namespace flow = tbb::flow;
+
+    flow::graph g;
+    size_t position = 0;
+
+    flow::input_node<range> source(g, [&](tbb::flow_control &control) -> range {
+        if (position >= frontier.size() || !coverage::worth_computing()) {
+            control.stop();
+            return {};
+        }
+        range r(position, std::min(frontier.size(), position + BLOCK));
+        position = r.second;
+        return r;
+    });
+    flow::limiter_node<range> limiter(g, IN_FLIGHT);
+
+    flow::function_node<range, batch> expand_stage(g, allocation[EXPAND], [&](const range &r) {
+        return timed(counters[EXPAND], r.second - r.first, [&] {
+            batch children = std::make_shared<std::vector<SO6>>();
+            const int count = 15 * symmetry::orientations();
+            children->reserve(count * (r.second - r.first));
+            for (size_t i = r.first; i < r.second; ++i) {
+                const SO6 S = frontier[i];
+                const SO6 transposed = symmetry::enabled() ? S.transpose(false) : SO6();
+                const uint32_t skip = bfs::skipped(S, transposed);
+                for (int c = 0; c < count; ++c)
+                    if (!(skip >> c & 1)) children->push_back(symmetry::child(S, transposed, c));
+            }
+            run_stats::work_done(r.second - r.first);
+            run_stats::children(children->size());
+            return children;
+        });
+    });
+
+    flow::function_node<batch, batch> dedup_stage(g, allocation[DEDUP], [&](const batch &children) {
+        return timed(counters[DEDUP], children->size(), [&] {
+            batch fresh = std::make_shared<std::vector<SO6>>();
+            for (SO6 &child : *children) {
+                if (prior.contains(child) || !next.insert(child).second) {
+                    run_stats::dedup_hit();
+                    continue;
+                }
+                run_stats::new_node();
+                fresh->push_back(std::move(child));
+            }
+            return fresh;
+        });
+    });
+
+    flow::function_node<batch, batch> pattern_stage(g, allocation[PATTERN], [&](const batch &fresh) {
+        return timed(counters[PATTERN], fresh->size(), [&] {
+            if (symmetry::enabled()) {      // The other class of each pair has its own patterns
+                const size_t n = fresh->size();
+                for (size_t i = 0; i < n; ++i) fresh->push_back((*fresh)[i].transpose(false));
+            }
+            std::vector<uint72_t> bits(fresh->size());
+            std::vector<uint8_t> cases(fresh->size());
+            for (size_t i = 0; i < fresh->size(); ++i) bits[i] = (*fresh)[i].pattern_bits();
+            pattern::case_nums(bits.data(), bits.size(), cases.data());
+
+            batch selected = std::make_shared<std::vector<SO6>>();
+            for (size_t i = 0; i < fresh->size(); ++i)
+                if (coverage::wants(cases[i]) && select((*fresh)[i])) selected->push_back(std::move((*fresh)[i]));
+            return selected;
+        });
+    });
+
+    flow::function_node<batch, flow::continue_msg> write_stage(g, flow::serial, [&](const batch &selected) {
+        timed(counters[WRITE], selected->size(), [&] {
+            for (SO6 &S : *selected) record(S);
+            return selected;
+        });
+        return flow::continue_msg();
+    });
+
+    flow::make_edge(source, limiter);
+    flow::make_edge(limiter, expand_stage);
+    flow::make_edge(expand_stage, dedup_stage);
+    flow::make_edge(dedup_stage, pattern_stage);
+    flow::make_edge(pattern_stage, write_stage);
+    flow::make_edge(write_stage, limiter.decrementer());    // A finished batch frees a slot
+    source.activate();
+    g.wait_for_all();
+}
+
+/**
+ * @brief Prints the throughput of each stage and names the bottleneck.
+ *
+ * The bottleneck is the stage with the most busy time per thread it was given.
+ */
+void pipeline::report() {
+    int bottleneck = EXPAND;
+    double worst = 0;
+    for (int s = EXPAND; s < STAGES; ++s) {
+        const stage_stats &c = counters[s];
+        const double busy = c.busy_ns / 1e9;
+        const double per_thread = busy / allocation[s];
+        if (per_thread > worst) {
+            worst = per_thread;
+            bottleneck = s;
+        }
+        std::cout << "[Pipeline] " << std::left << std::setw(8) << stage_names[s] << std::right
+                  << allocation[s] << " threads, " << c.batches << " batches, " << c.items_in << " in, " << c.items_out
+                  << " out, busy " << busy << "s, " << (busy > 0 ? c.items_in / busy : 0) << " items/s" << std::endl;
+    }
+    std::cout << "[Pipeline] Bottleneck: " << stage_names[bottleneck] << std::endl;
+}
@@ -0,0 +1,60 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include "SO6.hpp"
+#include "bfs.hpp"
+
+/**
+ * @file pipeline.hpp
+ * @brief Breadth first layer expansion as a staged pipeline.
+ *
+ * Each child otherwise goes through multiply, canonicalize, dedup, pattern lookup and a locked
+ * file write on one thread. The pipeline splits this into stages that pass batches to each other:
+ *
+ * - expand: multiplies a block of frontier nodes by every T and canonicalizes the children
+ * - dedup: drops children in the prior layer and inserts the rest into the next layer
+ * - pattern: classifies the new children in one batch and claims those with target patterns
+ * - write: records the claimed children; it is serial, so it needs no lock
+ *
+ * Stages run as TBB flow graph nodes with their own concurrency limits, so the expensive
+ * canonicalization can be given more threads than the cheap stages. A limiter bounds the number of
+ * batches in flight, which bounds every queue between stages. Per-stage counters show which stage
+ * is the bottleneck.
+ */
+class pipeline {
+public:
+    static constexpr size_t BLOCK = 32;         // Frontier nodes per batch
+    static constexpr size_t IN_FLIGHT = 64;     // Batches in the pipeline at once
+
+    enum stage { EXPAND, DEDUP, PATTERN, WRITE, STAGES };
+
+    /**
+     * @brief Throughput counters of one stage.
+     */
+    struct stage_stats {
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> items_in{0};
+        std::atomic<uint64_t> items_out{0};
+        std::atomic<uint64_t> busy_ns{0};
+    };
+
+    static void configure(const std::string &spec, const int threads);
+    static bool enabled() { return active; }
+    static int threads(const stage s) { return allocation[s]; }
+    static const stage_stats &stats(const stage s) { return counters[s]; }
+
+    static void expand(const packed_layer &frontier, const packed_layer &prior, bfs::node_set &next,
+                       const std::function<bool(SO6 &)> &select, const std::function<void(SO6 &)> &record);
+    static void report();
+
+private:
+    static bool active;
+    static int allocation[STAGES];
+    static stage_stats counters[STAGES];
+};
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,140 @@
+#include <chrono>
+#include "block_codec.hpp"
+#include "result_writer.hpp"
+
+/**
+ * @brief Opens the output file and starts the writer thread.
+ * @param path Path of the output file, truncated if it exists.
+ * @param f Record format.
+ */
+result_writer::result_writer(const std::string &path, const format f) : record_format(f) {
+    out.open(path, std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!out.is_open()) return;
+    if (record_format != TEXT) {
+        const char *magic = record_format == COMPRESSED ? COMPRESSED_MAGIC : MAGIC;
+        char header[HEADER_SIZE] = {magic[0], magic[1], magic[2], magic[3], VERSION & 0xFF, VERSION >> 8, 0, 0};
+        out.write(header, HEADER_SIZE);
+        written += HEADER_SIZE;
+    }
+    writer = std::thread(&result_writer::drain, this);
+}
+
+result_writer::~result_writer() {
+    close();
+}
+
+/**
+ * @brief Appends a circuit as a line of space separated gate indices.
+ * @param buffer Destination buffer.
+ * @param hist Gate history, two gates per byte.
+ */
+void result_writer::append_text(std::string &buffer, const std::vector<unsigned char> &hist) {
+    const size_t start = buffer.size();
+    for (const unsigned char byte : hist) {
+        for (const int nibble : {byte & 15, byte >> 4}) {
+            if (nibble == 0) continue;      // Unused upper nibble of the last byte
+            const int gate = nibble - 1;
+            if (gate >= 10) buffer.push_back('1');
+            buffer.push_back('0' + gate % 10);
+            buffer.push_back(' ');
+        }
+    }
+    if (buffer.size() > start) buffer.back() = '\n';
+    else buffer.push_back('\n');
+}
+
+/**
+ * @brief Appends a circuit as a binary record: its gate count and then its gates, two per byte.
+ *
+ * A product's history joins the histories of its factors byte by byte, so the unused upper nibble
+ * of a factor with an odd gate count can sit in the middle. As in append_text, such nibbles are
+ * skipped, and the gates are packed again so the count and the bytes describe the same circuit.
+ *
+ * @param buffer Destination buffer.
+ * @param hist Gate history, two gates per byte.
+ */
+void result_writer::append_binary(std::string &buffer, const std::vector<unsigned char> &hist) {
+    const size_t start = buffer.size();
+    buffer.push_back(0);    // The gate count, once known
+    size_t gates = 0;
+    for (const unsigned char byte : hist) {
+        for (const int nibble : {byte & 15, byte >> 4}) {
+            if (nibble == 0) continue;
+            if (gates % 2 == 0) buffer.push_back(static_cast<char>(nibble));
+            else buffer.back() = static_cast<char>(buffer.back() | nibble << 4);
+            ++gates;
+        }
+    }
+    buffer[start] = static_cast<char>(gates);
+}
+
+/**
+ * @brief Records a circuit. Safe to call from any number of threads at once.
+ * @param S The matrix whose history is recorded.
+ */
+void result_writer::record(const SO6 &S) {
+    std::string &buffer = buffers.local();
+    if (record_format != TEXT) append_binary(buffer, S.hist);
+    else append_text(buffer, S.hist);
+    count.fetch_add(1, std::memory_order_relaxed);
+    if (buffer.size() >= BLOCK_SIZE) submit(buffer);
+}
+
+/**
+ * @brief Hands a thread's buffer to the writer thread and leaves the buffer empty.
+ */
+void result_writer::submit(std::string &block) {
+    blocks.push(std::move(block));
+    block = std::string();
+    block.reserve(BLOCK_SIZE + 64);
+    wake.notify_one();
+}
+
+/**
+ * @brief Writes a block as it is, or compressed and framed by its lengths.
+ * @param block The records, which must not span blocks.
+ * @param compressed Scratch space for the compressed block.
+ */
+void result_writer::write_block(const std::string &block, std::string &compressed) {
+    if (record_format != COMPRESSED) {
+        out.write(block.data(), block.size());
+        written += block.size();
+        return;
+    }
+    block_codec::compress(block.data(), block.size(), compressed);
+    const std::string &payload = compressed.size() < block.size() ? compressed : block;
+    const uint32_t lengths[2] = {static_cast<uint32_t>(block.size()), static_cast<uint32_t>(payload.size())};
+    char frame[FRAME_SIZE];
+    for (int i = 0; i < 8; ++i) frame[i] = static_cast<char>(lengths[i / 4] >> (8 * (i % 4)));
+    out.write(frame, FRAME_SIZE);
+    out.write(payload.data(), payload.size());
+    written += FRAME_SIZE + payload.size();
+}
+
+/**
+ * @brief Writer thread: writes blocks as they arrive until the writer is closed and the queue is empty.
+ */
+void result_writer::drain() {
+    std::string block, compressed;
+    while (true) {
+        while (blocks.try_pop(block)) write_block(block, compressed);
+        if (closing.load()) break;
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait_for(lock, std::chrono::milliseconds(10));    // Timed, so a notify sent before the wait is never lost
+    }
+    while (blocks.try_pop(block)) write_block(block, compressed);
+}
+
+/**
+ * @brief Writes every remaining record and closes the file.
+ *
+ * Must only be called once no thread is recording, since it takes over the per-thread buffers.
+ */
+void result_writer::close() {
+    if (!writer.joinable()) return;
+    for (std::string &buffer : buffers) if (!buffer.empty()) submit(buffer);
+    closing.store(true);
+    wake.notify_one();
+    writer.join();
+    out.close();
+}
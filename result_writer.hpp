@@ -0,0 +1,76 @@
+#ifndef RESULT_WRITER_HPP
+#define RESULT_WRITER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tbb/concurrent_queue.h>
+#include <tbb/enumerable_thread_specific.h>
+#include "SO6.hpp"
+
+/**
+ * @file result_writer.hpp
+ * @brief Asynchronous writer for the circuits found in one T count.
+ *
+ * Compute threads append records to a buffer of their own and hand full buffers to a lock-free
+ * queue. A dedicated writer thread drains the queue in large blocks, so recording never takes a
+ * lock, never waits on the disk and never flushes per line.
+ *
+ * Two record formats are supported:
+ * - Text: one circuit per line as space separated gate indices, as SO6::circuit_string() prints.
+ * - Binary: an 8 byte header (magic "ESCB", version, reserved) followed by one record per circuit,
+ *   a byte holding the number of gates and then the gates packed two per byte exactly as SO6::hist
+ *   stores them (gate + 1 in each nibble, low nibble first).
+ * - Compressed: the binary records in blocks, each compressed on its own by block_codec on the
+ *   writer thread. The 8 byte header has the magic "ESCZ", and each block is framed by its length
+ *   before and after compression as two little endian 32 bit words. A block whose compressed form
+ *   is no shorter is stored as it is, with both lengths equal. Records never span blocks, so a
+ *   reader can decode any block without the ones before it.
+ */
+class result_writer {
+public:
+    enum format { TEXT, BINARY, COMPRESSED };
+
+    static constexpr char MAGIC[4] = {'E', 'S', 'C', 'B'};
+    static constexpr char COMPRESSED_MAGIC[4] = {'E', 'S', 'C', 'Z'};
+    static constexpr uint16_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 8;
+    static constexpr size_t BLOCK_SIZE = 1 << 16;   // Bytes buffered per thread before handing off a block
+    static constexpr size_t FRAME_SIZE = 8;         // Lengths framing each compressed block
+
+    result_writer(const std::string &path, const format f = TEXT);
+    ~result_writer();
+    result_writer(const result_writer &) = delete;
+    result_writer &operator=(const result_writer &) = delete;
+
+    bool is_open() const { return out.is_open(); }
+    uint64_t records() const { return count.load(std::memory_order_relaxed); }
+    uint64_t bytes_written() const { return written.load(std::memory_order_relaxed); }
+
+    void record(const SO6 &S);
+    void close();
+
+    static void append_text(std::string &buffer, const std::vector<unsigned char> &hist);
+    static void append_binary(std::string &buffer, const std::vector<unsigned char> &hist);
+
+private:
+    void submit(std::string &block);
+    void drain();
+    void write_block(const std::string &block, std::string &compressed);
+
+    const format record_format;
+    std::ofstream out;
+    tbb::enumerable_thread_specific<std::string> buffers;
+    tbb::concurrent_queue<std::string> blocks;
+    std::thread writer;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> closing{false};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> written{0};
+};
+
+#endif // RESULT_WRITER_HPP
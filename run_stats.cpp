@@ -0,0 +1,241 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "coverage.hpp"
+#include "memory.hpp"
+#include "run_stats.hpp"
+
+run_stats::slot run_stats::slots[run_stats::SLOTS];
+std::atomic<int> run_stats::next_slot{0};
+std::atomic<uint64_t> run_stats::patterns_remaining{0};
+
+std::mutex run_stats::state_mutex;
+bool run_stats::layer_active = false;
+int run_stats::layer_T = 0;
+std::string run_stats::layer_phase;
+uint64_t run_stats::layer_work = 0;
+run_stats::totals run_stats::layer_start;
+std::chrono::steady_clock::time_point run_stats::layer_start_time;
+std::chrono::steady_clock::time_point run_stats::layer_end_time;
+std::vector<run_stats::layer_size> run_stats::layers;
+
+std::string run_stats::json_file;
+bool run_stats::plain_log = false;
+double run_stats::interval = 1;
+std::thread run_stats::reporter;
+std::condition_variable run_stats::wake;
+bool run_stats::stopping = false;
+
+/**
+ * @brief Starts the reporter thread.
+ * @param json_path File rewritten with the stats on every report, or empty for none.
+ * @param interval_seconds Time between reports.
+ * @param plain If true, print one plain line per report instead of redrawing the progress lines.
+ */
+void run_stats::start(const std::string &json_path, const double interval_seconds, const bool plain) {
+    stop();
+    static const bool stop_at_exit = std::atexit([] { stop(); }) == 0;   // A running thread must be joined before its destructor
+    (void) stop_at_exit;
+    json_file = json_path;
+    interval = interval_seconds;
+    plain_log = plain;
+    stopping = false;
+    reporter = std::thread([] {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        while (!stopping) {
+            wake.wait_for(lock, std::chrono::duration<double>(interval));
+            if (stopping) break;
+            lock.unlock();
+            report();
+            lock.lock();
+        }
+    });
+}
+
+/**
+ * @brief Stops the reporter thread after writing the stats file one last time.
+ */
+void run_stats::stop() {
+    if (!reporter.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    reporter.join();
+    report();
+}
+
+/**
+ * @brief The escape codes that move the cursor up over the given number of lines, or nothing in log mode.
+ */
+const char *run_stats::rewind(const int lines) {
+    if (plain_log) return "";
+    return lines >= 2 ? "\033[A\033[A\r" : "\033[A\r";
+}
+
+/**
+ * @brief Marks the start of a layer, from which rates, progress and ETA are measured.
+ * @param T The T count being generated.
+ * @param phase Name of the phase, such as "bfs" or "free_multiply".
+ * @param work Number of matrices the layer will process.
+ */
+void run_stats::begin_layer(const int T, const std::string &phase, const uint64_t work) {
+    const totals start = sum();
+    std::lock_guard<std::mutex> lock(state_mutex);
+    layer_active = true;
+    layer_T = T;
+    layer_phase = phase;
+    layer_work = work;
+    layer_start = start;
+    layer_start_time = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Marks the end of the current layer. Once it returns the progress lines are no longer redrawn.
+ */
+void run_stats::end_layer() {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    layer_active = false;
+    layer_end_time = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Seconds spent in the current layer, or in the last one once it has ended.
+ */
+double run_stats::layer_elapsed() {
+    const auto end = layer_active ? std::chrono::steady_clock::now() : layer_end_time;
+    return std::chrono::duration<double>(end - layer_start_time).count();
+}
+
+/**
+ * @brief Records the size of a finished layer for the stats file.
+ * @param T The T count of the layer.
+ * @param matrices Number of matrices in the layer.
+ * @param bytes Memory held by the layer.
+ */
+void run_stats::record_layer(const int T, const uint64_t matrices, const uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    layers.push_back({T, matrices, bytes});
+}
+
+/**
+ * @brief Sums the counters of every thread.
+ */
+run_stats::totals run_stats::sum() {
+    totals t;
+    for (const slot &s : slots) {
+        t.work += s.work.load(std::memory_order_relaxed);
+        t.children += s.children.load(std::memory_order_relaxed);
+        t.pruned += s.pruned.load(std::memory_order_relaxed);
+        t.same_orbit += s.same_orbit.load(std::memory_order_relaxed);
+        t.dedup_hits += s.dedup_hits.load(std::memory_order_relaxed);
+        t.new_nodes += s.new_nodes.load(std::memory_order_relaxed);
+        t.pattern_hits += s.pattern_hits.load(std::memory_order_relaxed);
+    }
+    return t;
+}
+
+/**
+ * @brief Clears the counters and layer history. Only for use while no thread is counting.
+ */
+void run_stats::reset() {
+    stop();
+    for (slot &s : slots) {
+        s.work = s.children = s.pruned = s.same_orbit = s.dedup_hits = s.new_nodes = s.pattern_hits = 0;
+    }
+    std::lock_guard<std::mutex> lock(state_mutex);
+    layer_active = false;
+    layers.clear();
+    json_file.clear();
+    plain_log = false;
+}
+
+/**
+ * @brief The current stats as a JSON object.
+ */
+std::string run_stats::json() {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return json_unlocked();
+}
+
+std::string run_stats::json_unlocked() {
+    const totals now = sum();
+    const totals &s = layer_start;
+    const double elapsed = layer_elapsed();
+    const uint64_t done = now.work - s.work;
+    const uint64_t children = now.children - s.children;
+    const uint64_t dedup_hits = now.dedup_hits - s.dedup_hits;
+    const double rate = elapsed > 0 ? done / elapsed : 0;
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"layer\": {\"T\": " << layer_T << ", \"phase\": \"" << layer_phase << "\", \"active\": "
+        << (layer_active ? "true" : "false") << ", \"elapsed_s\": " << elapsed << ", \"work_done\": " << done
+        << ", \"work_total\": " << layer_work
+        << ", \"progress\": " << (layer_work > 0 ? std::min(1.0, (double) done / layer_work) : 0.0)
+        << ", \"eta_s\": ";
+    if (layer_active && rate > 0 && layer_work >= done) out << (layer_work - done) / rate;
+    else out << "null";
+    out << "},\n";
+    out << "  \"nodes_per_s\": " << (elapsed > 0 ? children / elapsed : 0) << ",\n";
+    out << "  \"dedup_hit_rate\": " << (children > 0 ? (double) dedup_hits / children : 0.0) << ",\n";
+    out << "  \"patterns_remaining\": " << patterns_remaining.load(std::memory_order_relaxed) << ",\n";
+    out << "  \"cases_remaining\": " << __builtin_popcount(coverage::remaining()) << ",\n";
+    out << "  \"totals\": {\"work\": " << now.work << ", \"children\": " << now.children << ", \"pruned\": " << now.pruned << ", \"same_orbit\": " << now.same_orbit << ", \"dedup_hits\": "
+        << now.dedup_hits << ", \"new_nodes\": " << now.new_nodes << ", \"pattern_hits\": " << now.pattern_hits << "},\n";
+    out << "  \"layers\": [";
+    for (size_t i = 0; i < layers.size(); ++i)
+        out << (i ? ", " : "") << "{\"T\": " << layers[i].T << ", \"matrices\": " << layers[i].matrices
+            << ", \"bytes\": " << layers[i].bytes << "}";
+    out << "],\n";
+    out << "  \"memory\": " << memory::json() << "\n}\n";
+    return out.str();
+}
+
+/**
+ * @brief Prints the progress of the current layer, redrawing the progress lines unless in log mode.
+ */
+void run_stats::print_progress(const totals &now, const double elapsed) {
+    const uint64_t done = now.work - layer_start.work;
+    const uint64_t children = now.children - layer_start.children;
+    const uint64_t dedup_hits = now.dedup_hits - layer_start.dedup_hits;
+    const uint64_t percent = layer_work > 0 ? std::min<uint64_t>(100, 100 * done / layer_work) : 0;
+    const uint64_t nodes_per_s = elapsed > 0 ? children / elapsed : 0;
+    std::ostringstream eta;
+    if (done > 0 && layer_work > done) eta << ", ETA " << (uint64_t) ((layer_work - done) * elapsed / done) << "s";
+
+    if (plain_log) {
+        std::ostringstream dedup;
+        if (now.new_nodes > layer_start.new_nodes || dedup_hits > 0)     // Only layers that deduplicate have a hit rate
+            dedup << "dedup hit rate " << std::fixed << std::setprecision(1) << 100.0 * dedup_hits / children << "%, ";
+        std::cout << " ||\t↪ [Stats] T=" << layer_T << " " << layer_phase << " " << percent << "%, " << nodes_per_s
+                  << " nodes/s, " << dedup.str() << patterns_remaining.load(std::memory_order_relaxed) << " patterns remain" << eta.str() << std::endl;
+    } else {
+        std::cout << "\033[A\033[A\r ||\t↪ [Progress] Processing .....    " << percent << "%  (" << nodes_per_s
+                  << " nodes/s" << eta.str() << ")\033[K\n ||\t↪ [Patterns] "
+                  << patterns_remaining.load(std::memory_order_relaxed) << " patterns remain.\033[K" << std::endl;
+    }
+}
+
+/**
+ * @brief Prints the progress of the active layer, if any, and rewrites the stats file.
+ */
+void run_stats::report() {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (layer_active) {
+        print_progress(sum(), layer_elapsed());
+    }
+    if (json_file.empty()) return;
+    const std::string temporary = json_file + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        if (!out.is_open()) return;
+        out << json_unlocked();
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, json_file, error);     // Readers never see a half written file
+}
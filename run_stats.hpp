@@ -0,0 +1,111 @@
+#ifndef RUN_STATS_HPP
+#define RUN_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @file run_stats.hpp
+ * @brief Live throughput and progress counters with a background reporter.
+ *
+ * Every thread counts into a cache-line sized slot of its own with relaxed atomic adds, so counting
+ * never contends and is correct under any schedule. A reporter thread sums the slots periodically,
+ * redraws the progress lines (or prints one plain line per report in log mode, for output that is
+ * redirected to a file) and rewrites a JSON stats file with the current layer's nodes/s, dedup hit
+ * rate, patterns remaining, ETA, the size of every finished layer and the memory snapshots of memory.hpp.
+ *
+ * A layer is the work between begin_layer() and end_layer(). Progress lines are only drawn while a
+ * layer is active, so they never overwrite the lines printed between layers.
+ */
+class run_stats {
+public:
+    static constexpr int SLOTS = 256;   // Threads beyond this share slots, which stays correct since adds are atomic
+
+    struct totals {
+        uint64_t work = 0;          // Frontier or stored matrices processed
+        uint64_t children = 0;      // Products formed
+        uint64_t pruned = 0;        // Children skipped because they cancel a T matrix of their parent
+        uint64_t same_orbit = 0;    // Children skipped because a sibling is in the same class
+        uint64_t dedup_hits = 0;    // Products already in the prior or next layer
+        uint64_t new_nodes = 0;     // Products inserted into the next layer
+        uint64_t pattern_hits = 0;  // Products whose pattern was found and recorded
+    };
+
+    struct layer_size {
+        int T;
+        uint64_t matrices;
+        uint64_t bytes;
+    };
+
+    static void start(const std::string &json_path, const double interval_seconds, const bool plain);
+    static void stop();
+    static bool plain() { return plain_log; }
+    static const char *rewind(const int lines);
+
+    static void begin_layer(const int T, const std::string &phase, const uint64_t work);
+    static void end_layer();
+    static void record_layer(const int T, const uint64_t matrices, const uint64_t bytes);
+    static void set_patterns(const uint64_t n) { patterns_remaining.store(n, std::memory_order_relaxed); }
+
+    static void work_done(const uint64_t n = 1) { local().work.fetch_add(n, std::memory_order_relaxed); }
+    static void children(const uint64_t n) { local().children.fetch_add(n, std::memory_order_relaxed); }
+    static void pruned(const uint64_t n) { local().pruned.fetch_add(n, std::memory_order_relaxed); }
+    static void same_orbit(const uint64_t n) { local().same_orbit.fetch_add(n, std::memory_order_relaxed); }
+    static void dedup_hit() { local().dedup_hits.fetch_add(1, std::memory_order_relaxed); }
+    static void new_node() { local().new_nodes.fetch_add(1, std::memory_order_relaxed); }
+    static void pattern_hit() { local().pattern_hits.fetch_add(1, std::memory_order_relaxed); }
+
+    static totals sum();
+    static std::string json();
+    static void reset();
+
+private:
+    struct alignas(64) slot {
+        std::atomic<uint64_t> work{0};
+        std::atomic<uint64_t> children{0};
+        std::atomic<uint64_t> pruned{0};
+        std::atomic<uint64_t> same_orbit{0};
+        std::atomic<uint64_t> dedup_hits{0};
+        std::atomic<uint64_t> new_nodes{0};
+        std::atomic<uint64_t> pattern_hits{0};
+    };
+
+    static slot &local() {
+        static thread_local slot &s = slots[next_slot.fetch_add(1, std::memory_order_relaxed) % SLOTS];
+        return s;
+    }
+
+    static void report();
+    static std::string json_unlocked();
+    static double layer_elapsed();
+    static void print_progress(const totals &t, const double elapsed);
+
+    static slot slots[SLOTS];
+    static std::atomic<int> next_slot;
+    static std::atomic<uint64_t> patterns_remaining;
+
+    static std::mutex state_mutex;      // Guards everything below and the progress lines on stdout
+    static bool layer_active;
+    static int layer_T;
+    static std::string layer_phase;
+    static uint64_t layer_work;
+    static totals layer_start;
+    static std::chrono::steady_clock::time_point layer_start_time;
+    static std::chrono::steady_clock::time_point layer_end_time;
+    static std::vector<layer_size> layers;
+
+    static std::string json_file;
+    static bool plain_log;
+    static double interval;
+    static std::thread reporter;
+    static std::condition_variable wake;
+    static bool stopping;
+};
+
+#endif // RUN_STATS_HPP
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <tbb/parallel_for.h>
+#include <unistd.h>
+#include "server.hpp"
+#include "synth.hpp"
+
+std::mutex server::latency_mutex;
+std::vector<double> server::latencies_us;
+std::atomic<bool> server::stopping = false;
+
+/**
+ * @brief Writes all of a reply, retrying short writes.
+ *
+ * Sockets are written with MSG_NOSIGNAL, so a client that disconnects before its reply makes the
+ * write fail instead of raising SIGPIPE. Pipes, such as stdout, fall back to write().
+ *
+ * @return false if the peer is gone.
+ */
+static bool write_all(const int fd, const std::string &reply) {
+    for (size_t sent = 0; sent < reply.size(); ) {
+        ssize_t n = send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) n = write(fd, reply.data() + sent, reply.size() - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Answers one batch of targets in parallel and records their latencies.
+ * @param batch The target lines.
+ * @param max_T The largest T count to search.
+ * @return The reply lines, in the order of the batch, ending with END.
+ */
+std::string server::answer(const std::vector<std::string> &batch, const int max_T) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> replies(batch.size());
+    std::vector<double> times(batch.size(), -1);
+    tbb::parallel_for(size_t(0), batch.size(), [&](const size_t i) {
+        const auto query_start = std::chrono::steady_clock::now();
+        SO6 target;
+        synth::result r;
+        try {
+            if (!synth::parse(batch[i], target)) {
+                replies[i] = "ERR " + batch[i];
+                return;
+            }
+            r = synth::query(target, max_T);
+        } catch (const std::exception &) {     // Would otherwise end a detached session thread, and the server with it
+            replies[i] = "ERR " + batch[i];
+            return;
+        }
+        times[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - query_start).count();     // Canonicalizing the target included
+        replies[i] = r.found ? "OK " + std::to_string(r.T) + " " + std::to_string((uint64_t) times[i]) + " " + r.circuit
+                             : "NONE " + std::to_string((uint64_t) times[i]);
+    });
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        for (const double t : times) if (t >= 0) latencies_us.push_back(t);
+    }
+    std::string out;
+    for (const std::string &reply : replies) out += reply + "\n";
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    return out + "END " + std::to_string(batch.size()) + " " + std::to_string(elapsed) + "\n";
+}
+
+/**
+ * @brief Serves one client until it quits, its input ends or the server is stopped.
+ * @param in Descriptor the requests are read from.
+ * @param out Descriptor the replies are written to.
+ * @param max_T The largest T count to search.
+ * @return true if the client asked the server to shut down.
+ */
+bool server::session(const int in, const int out, const int max_T) {
+    std::vector<std::string> batch;
+    std::string pending;
+    char buffer[1 << 16];
+    bool open = true;
+    while (open && !stopping) {
+        const ssize_t n = read(in, buffer, sizeof(buffer));
+        if (n <= 0) {
+            open = false;
+            if (!pending.empty()) pending += '\n';     // Answer a last line sent without a newline
+        } else {
+            pending.append(buffer, n);
+        }
+        size_t line_start = 0;
+        for (size_t newline; (newline = pending.find('\n', line_start)) != std::string::npos; line_start = newline + 1) {
+            std::string line = pending.substr(line_start, newline - line_start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line == "QUIT") return false;
+            if (line == "SHUTDOWN") {
+                stopping = true;
+                return true;
+            }
+            if (line == "STATS") {
+                if (!write_all(out, stats() + "\n")) return false;
+            } else if (line.empty() && !batch.empty()) {
+                if (!write_all(out, answer(batch, max_T))) return false;
+                batch.clear();
+            } else if (!line.empty() && line[0] != '#') {
+                batch.push_back(line);
+            }
+        }
+        pending.erase(0, line_start);
+    }
+    if (!batch.empty()) write_all(out, answer(batch, max_T));     // The input ended inside a batch
+    return false;
+}
+
+/**
+ * @brief Serves the requests read from stdin, replying on stdout.
+ */
+int server::serve_stdin(const int max_T) {
+    std::cerr << "[Serve] Reading queries from stdin." << std::endl;     // stdout carries only replies from here on
+    std::signal(SIGPIPE, SIG_IGN);      // A closed stdout ends the session instead of the process
+    session(STDIN_FILENO, STDOUT_FILENO, max_T);
+    std::cerr << "[Serve] " << stats() << std::endl;
+    return 0;
+}
+
+/**
+ * @brief Serves every client that connects to a Unix socket, each on its own thread, until one sends SHUTDOWN.
+ *
+ * The resident layers are freed once the program returns, so on SHUTDOWN every other session is
+ * woken by shutting its socket down and joined before this returns. A session's socket is closed
+ * only once its thread is joined, so its descriptor is never reused while it could still be shut down.
+ *
+ * @param path Path of the socket. A stale socket file is replaced.
+ * @param max_T The largest T count to search.
+ * @return The exit status of the program.
+ */
+int server::serve_socket(const std::string &path, const int max_T) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "[Serve] Socket path too long: " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    address.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), address.sun_path);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (listener < 0 || bind(listener, (sockaddr *) &address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+        std::cerr << "[Serve] Could not listen on " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "[Serve] Listening on " << path << std::endl;
+
+    struct client_session {
+        int fd;
+        std::atomic<bool> done = false;
+        std::thread thread;
+    };
+    std::list<client_session> sessions;
+    while (!stopping) {
+        const int client = accept(listener, nullptr, nullptr);
+        if (client < 0) break;     // Closed by SHUTDOWN
+        for (auto it = sessions.begin(); it != sessions.end(); ) {     // Reaps the sessions that have ended
+            if (!it->done) {
+                ++it;
+                continue;
+            }
+            it->thread.join();
+            close(it->fd);
+            it = sessions.erase(it);
+        }
+        client_session &s = sessions.emplace_back();
+        s.fd = client;
+        s.thread = std::thread([&s, listener, max_T] {
+            if (session(s.fd, s.fd, max_T)) shutdown(listener, SHUT_RDWR);     // Wakes the accept loop
+            s.done = true;
+        });
+    }
+    for (client_session &s : sessions) shutdown(s.fd, SHUT_RDWR);     // Wakes sessions blocked in read()
+    for (client_session &s : sessions) {
+        s.thread.join();
+        close(s.fd);
+    }
+    close(listener);
+    unlink(path.c_str());
+    std::cout << "[Serve] " << stats() << std::endl;
+    return 0;
+}
+
+/**
+ * @brief Latency summary of every query answered since the last reset().
+ */
+std::string server::stats() {
+    std::vector<double> sorted;
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        sorted = latencies_us;
+    }
+    std::ostringstream out;
+    out << "STATS queries=" << sorted.size();
+    if (sorted.empty()) return out.str();
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (const double t : sorted) total += t;
+    auto percentile = [&](const double p) { return sorted[std::min(sorted.size() - 1, (size_t) (p * sorted.size()))]; };
+    out << " mean_us=" << (uint64_t) (total / sorted.size()) << " p50_us=" << (uint64_t) percentile(0.5)
+        << " p99_us=" << (uint64_t) percentile(0.99) << " max_us=" << (uint64_t) sorted.back();
+    return out.str();
+}
+
+void server::reset() {
+    std::lock_guard<std::mutex> lock(latency_mutex);
+    latencies_us.clear();
+    stopping = false;
+}
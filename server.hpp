@@ -0,0 +1,41 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @file server.hpp
+ * @brief Long running synthesis server over stdin or a Unix socket.
+ *
+ * The layers from the identity are built, or loaded, once by synth::prepare() and stay resident,
+ * so each query only pays for the layers it expands from its own target. Clients speak a line
+ * protocol:
+ *
+ *   - A circuit or matrix line, as in a --query file, is a target. Targets are collected into a
+ *     batch until an empty line, then answered in parallel. Each gets one reply, in order:
+ *     "OK <T> <microseconds> <circuit>", "NONE <microseconds>" if it needs more than the T count
+ *     limit, or "ERR <line>" if it does not parse. "END <targets> <microseconds>" closes the batch.
+ *   - "STATS" replies with the number of queries answered and their mean, median, 99th percentile
+ *     and largest latency in microseconds since the server started.
+ *   - "QUIT" ends the session and "SHUTDOWN" stops the server.
+ */
+class server {
+public:
+    static int serve_stdin(const int max_T);
+    static int serve_socket(const std::string &path, const int max_T);
+    static bool session(const int in, const int out, const int max_T);
+    static std::string stats();
+    static void reset();
+
+private:
+    static std::string answer(const std::vector<std::string> &batch, const int max_T);
+
+    static std::mutex latency_mutex;
+    static std::vector<double> latencies_us;     // Every query's time, guarded by latency_mutex
+    static std::atomic<bool> stopping;
+};
+
+#endif // SERVER_HPP
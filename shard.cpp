@@ -0,0 +1,170 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <tbb/parallel_for.h>
+#include "result_writer.hpp"
+#include "shard.hpp"
+
+int shard::shard_index = 0;
+int shard::count = 0;
+
+/**
+ * @brief Enables shard mode.
+ * @param spec The shard as "i/N" with 0 <= i < N.
+ * @throws std::invalid_argument if spec is not of that form.
+ */
+void shard::configure(const std::string &spec) {
+    const size_t slash = spec.find('/');
+    if (slash == std::string::npos) throw std::invalid_argument("expected i/N, found " + spec);
+    const int i = std::stoi(spec.substr(0, slash));
+    const int n = std::stoi(spec.substr(slash + 1));
+    if (n < 1 || i < 0 || i >= n) throw std::invalid_argument("shard index must satisfy 0 <= i < N in " + spec);
+    shard_index = i;
+    count = n;
+}
+
+std::string shard::layer_path(const std::string &name) {
+    return std::string(LAYER_DIR) + "/" + name + ".bin";
+}
+
+/**
+ * @brief Output file of T count t for this process: the shard's own file in shard mode.
+ */
+std::string shard::output_path(const int t) {
+    return active() ? output_path(t, shard_index, count) : "./data/" + std::to_string(t) + ".dat";
+}
+
+std::string shard::output_path(const int t, const int i, const int n) {
+    return "./data/" + std::to_string(t) + ".shard" + std::to_string(i) + "of" + std::to_string(n) + ".dat";
+}
+
+std::string shard::coverage_path(const int i, const int n) {
+    return "./data/coverage.shard" + std::to_string(i) + "of" + std::to_string(n);
+}
+
+/**
+ * @brief Saves a layer as binary circuit records, shard after shard in order.
+ * @param name Name of the layer within LAYER_DIR.
+ * @param layer The matrices to save.
+ */
+void shard::save_layer(const std::string &name, const bfs::layer &layer) {
+    std::filesystem::create_directories(LAYER_DIR);
+    result_writer out(layer_path(name), result_writer::BINARY);
+    for (const packed_layer &part : layer)
+        for (size_t i = 0; i < part.size(); ++i) out.record(part.matrix(i));    // One thread, so records keep the layer's order
+}
+
+/**
+ * @brief Loads a layer saved by save_layer() by replaying each circuit from the identity.
+ * @param name Name of the layer within LAYER_DIR.
+ * @param owned_only If true, only the positions owned by this shard are loaded.
+ * @return The matrices packed, in file order.
+ * @throws std::runtime_error if the file is missing or malformed.
+ */
+packed_layer shard::load_layer(const std::string &name, const bool owned_only) {
+    const std::string path = layer_path(name);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) throw std::runtime_error("missing layer file " + path);
+    const std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (bytes.size() < result_writer::HEADER_SIZE || std::memcmp(bytes.data(), result_writer::MAGIC, 4) != 0)
+        throw std::runtime_error("invalid layer file header in " + path);
+
+    std::vector<size_t> offsets;    // Offset of each owned record
+    size_t position = 0;
+    for (size_t pos = result_writer::HEADER_SIZE; pos < bytes.size(); ++position) {
+        const size_t length = 1 + (static_cast<uint8_t>(bytes[pos]) + 1) / 2;
+        if (pos + length > bytes.size()) throw std::runtime_error("truncated record in " + path);
+        if (!owned_only || owns(position)) offsets.push_back(pos);
+        pos += length;
+    }
+
+    // Replay the circuits a block at a time, so only one block is ever held as working matrices
+    packed_layer layer;
+    layer.reserve(offsets.size());
+    std::vector<SO6> block;
+    for (size_t begin = 0; begin < offsets.size(); begin += LOAD_BLOCK) {
+        block.resize(std::min(LOAD_BLOCK, offsets.size() - begin));
+        tbb::parallel_for(size_t(0), block.size(), [&](const size_t b) {
+            const size_t offset = offsets[begin + b], gates = static_cast<uint8_t>(bytes[offset]);
+            SO6 S = SO6::identity();
+            for (size_t g = 0; g < gates; ++g) {
+                const uint8_t byte = bytes[offset + 1 + g / 2];
+                S = S.left_multiply_by_T(((g & 1) ? (byte >> 4) : (byte & 15)) - 1);
+            }
+            block[b] = std::move(S);
+        });
+        for (const SO6 &S : block) layer.push_back(S);
+    }
+    return layer;
+}
+
+/**
+ * @brief Records the depths the saved layers were built for.
+ */
+void shard::save_manifest(const int target_T_count, const int stored_depth_max) {
+    std::filesystem::create_directories(LAYER_DIR);
+    std::ofstream out(std::string(LAYER_DIR) + "/manifest", std::ios::trunc);
+    out << target_T_count << " " << stored_depth_max << " " << symmetry::enabled() << "\n";     // Whether the stored layer holds one class per inverse pair
+}
+
+/**
+ * @brief Checks that the saved layers were built for the same depths as this run.
+ * @return false, after printing why, if the manifest is missing or differs.
+ */
+bool shard::check_manifest(const int target_T_count, const int stored_depth_max) {
+    std::ifstream in(std::string(LAYER_DIR) + "/manifest");
+    int saved_target = 0, saved_depth = 0;
+    if (!(in >> saved_target >> saved_depth)) {
+        std::cerr << "[Shard] No saved layers in " << LAYER_DIR << ", run once with --save_layers first." << std::endl;
+        return false;
+    }
+    if (saved_target != target_T_count || saved_depth != stored_depth_max) {
+        std::cerr << "[Shard] Saved layers are for T=" << saved_target << " with stored depth " << saved_depth
+                  << ", but this run is for T=" << target_T_count << " with stored depth " << stored_depth_max << "." << std::endl;
+        return false;
+    }
+    bool saved_symmetry = false;
+    in >> saved_symmetry;     // Absent from manifests saved before transpose symmetry
+    if (saved_symmetry != symmetry::enabled()) {
+        std::cerr << "[Shard] Saved layers were built " << (saved_symmetry ? "with" : "without") << " --transpose, so this run must be too." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Concatenates the shard outputs of each T count into ./data/<t>.dat.
+ *
+ * Binary and compressed outputs keep the header of the first shard file only, and compressed blocks
+ * stay whole, so the merged file reads like one written at once. Shard files are left in place.
+ *
+ * @param n Number of shards.
+ * @param first_T First T count to merge.
+ * @param last_T Last T count to merge.
+ */
+void shard::merge_outputs(const int n, const int first_T, const int last_T) {
+    for (int t = first_T; t <= last_T; ++t) {
+        std::ofstream out("./data/" + std::to_string(t) + ".dat", std::ios::trunc | std::ios::binary);
+        bool header_written = false;
+        uint64_t bytes_merged = 0;
+        for (int i = 0; i < n; ++i) {
+            std::ifstream in(output_path(t, i, n), std::ios::binary);
+            if (!in.is_open()) {
+                std::cerr << "[Merge] Missing " << output_path(t, i, n) << std::endl;
+                continue;
+            }
+            std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            size_t start = 0;
+            if (bytes.size() >= result_writer::HEADER_SIZE && (std::memcmp(bytes.data(), result_writer::MAGIC, 4) == 0
+                                                               || std::memcmp(bytes.data(), result_writer::COMPRESSED_MAGIC, 4) == 0)) {
+                if (header_written) start = result_writer::HEADER_SIZE;
+                header_written = true;
+            }
+            out.write(bytes.data() + start, bytes.size() - start);
+            bytes_merged += bytes.size() - start;
+        }
+        std::cout << "[Merge] T=" << t << ": " << bytes_merged << " bytes from " << n << " shards" << std::endl;
+    }
+}
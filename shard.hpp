@@ -0,0 +1,52 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <string>
+#include <vector>
+#include "SO6.hpp"
+#include "bfs.hpp"
+
+/**
+ * @file shard.hpp
+ * @brief Splits the free multiply phase across independent processes.
+ *
+ * A run with --save_layers performs the BFS phase once and saves the stored layer and the
+ * generating sets to ./data/layers as binary circuit records, with a manifest of the depths they
+ * were built for and the cases the BFS phase already found. Each process started with --shard i/N
+ * loads those files, keeps every N-th stored matrix starting at position i, and writes its results
+ * to ./data/<t>.shard<i>of<N>.dat along with the cases it found. A final run with --merge N
+ * concatenates the outputs into ./data/<t>.dat and merges the coverage. Since shards share nothing
+ * but files, several processes on one machine behave exactly like processes on several machines
+ * with a shared filesystem.
+ */
+class shard {
+public:
+    static constexpr const char *LAYER_DIR = "./data/layers";
+    static constexpr size_t LOAD_BLOCK = 1 << 16;  // Circuits replayed at once while loading a layer
+
+    static void configure(const std::string &spec);
+    static void reset() { shard_index = count = 0; }
+    static bool active() { return count > 0; }
+    static int index() { return shard_index; }
+    static int total() { return count; }
+    static bool owns(const size_t position) { return !active() || (int) (position % count) == shard_index; }
+
+    static std::string layer_path(const std::string &name);
+    static std::string output_path(const int t);
+    static std::string output_path(const int t, const int i, const int n);
+    static std::string coverage_path(const int i, const int n);
+    static std::string layer_coverage_path() { return std::string(LAYER_DIR) + "/coverage"; }
+
+    static void save_layer(const std::string &name, const bfs::layer &layer);
+    static packed_layer load_layer(const std::string &name, const bool owned_only);
+    static void save_manifest(const int target_T_count, const int stored_depth_max);
+    static bool check_manifest(const int target_T_count, const int stored_depth_max);
+
+    static void merge_outputs(const int n, const int first_T, const int last_T);
+
+private:
+    static int shard_index;
+    static int count;
+};
+
+#endif // SHARD_HPP
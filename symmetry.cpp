@@ -0,0 +1,30 @@
+#include "symmetry.hpp"
+
+bool symmetry::active = false;
+
+/**
+ * @brief Replaces a matrix by the canonical representative of its inverse pair.
+ *
+ * Fingerprints need no canonical form and decide most pairs, so the matrix or its transpose is
+ * brought into canonical form once. Only matrices whose fingerprints tie pay for both.
+ *
+ * @param S A matrix, in canonical form or not.
+ */
+void symmetry::choose(SO6 &S) {
+    const uint64_t fp = S.fingerprint(), transposed = S.transposed_fingerprint();
+    if (fp > transposed) {
+        S = S.transpose();
+        return;
+    }
+    S.canonical_form();
+    if (fp < transposed) return;
+    SO6 t = S.transpose();
+    if ((t <=> S) < 0) S = std::move(t);
+}
+
+/**
+ * @brief Whether a canonical matrix is in the same class as its inverse, so the pair has one class.
+ */
+bool symmetry::self_inverse(const SO6 &S) {
+    return S.fingerprint() == S.transposed_fingerprint() && (S.transpose() <=> S) == 0;
+}
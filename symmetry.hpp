@@ -0,0 +1,45 @@
+#ifndef SYMMETRY_HPP
+#define SYMMETRY_HPP
+
+#include "SO6.hpp"
+
+/**
+ * @file symmetry.hpp
+ * @brief Stores one matrix of each pair of inverse classes.
+ *
+ * A matrix and its inverse, its transpose, have the same T count, so with transpose symmetry a
+ * layer holds one representative of the two classes: the one with the smaller fingerprint, or the
+ * one that compares less when the fingerprints tie. Layers then take about half the memory and half
+ * the dedup lookups.
+ *
+ * The other class of a pair is only formed when needed. A node's children are those of the node
+ * and of its transpose, each child's patterns are checked along with its transpose's, and the free
+ * multiply phase multiplies by both orientations of every stored matrix.
+ */
+class symmetry {
+public:
+    static void enable(const bool on) { active = on; }
+    static bool enabled() { return active; }
+    static int orientations() { return active ? 2 : 1; }
+
+    static void choose(SO6 &S);
+    static bool self_inverse(const SO6 &S);
+
+    /**
+     * @brief Child c of a node, and its representative with transpose symmetry.
+     * @param S The node.
+     * @param transposed S.transpose(false), only read with transpose symmetry.
+     * @param c Below 15 the T matrix applied to S, otherwise 15 more than the one applied to the transpose.
+     */
+    static SO6 child(const SO6 &S, const SO6 &transposed, const int c) {
+        if (!active) return S.left_multiply_by_T(c);
+        SO6 child = c < 15 ? S.left_multiply_by_T(c, false) : transposed.left_multiply_by_T(c - 15, false);
+        choose(child);
+        return child;
+    }
+
+private:
+    static bool active;
+};
+
+#endif // SYMMETRY_HPP
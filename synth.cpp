@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <regex>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+#include <tbb/parallel_for.h>
+#include <filesystem>
+#include "bfs.hpp"
+#include "shard.hpp"
+#include "synth.hpp"
+
+std::vector<packed_layer> synth::forward_layers;
+std::unordered_multimap<uint64_t, std::pair<uint32_t, uint32_t>> synth::forward_index;
+
+/**
+ * @brief Reads one field of a matrix entry, if it fits in a z2_int.
+ */
+static bool parse_field(const std::ssub_match &field, z2_int &value) {
+    long long v = 0;
+    const auto [end, error] = std::from_chars(&*field.first, &*field.first + field.length(), v);
+    if (error != std::errc() || end != &*field.first + field.length()) return false;
+    if (v < std::numeric_limits<z2_int>::min() || v > std::numeric_limits<z2_int>::max()) return false;
+    value = (z2_int) v;
+    return true;
+}
+
+/**
+ * @brief Checks that the columns of a matrix are orthonormal, in exact arithmetic.
+ *
+ * Each product of two entries is (p + q*sqrt(2))/sqrt(2)^e, and the terms of a dot product are
+ * brought to the largest e among them before they are summed. No entry of an orthogonal matrix
+ * exceeds 1, so none has k < 0, and parts that fit in a z2_int keep k far below MAX_EXPONENT, which
+ * keeps every sum well inside 64 bits.
+ */
+static bool orthogonal(const Z2 entries[6][6]) {
+    constexpr int MAX_EXPONENT = 30;
+    for (int row = 0; row < 6; ++row)
+        for (int col = 0; col < 6; ++col)
+            if (entries[row][col].exponent < 0 || entries[row][col].exponent > MAX_EXPONENT) return false;
+    for (int i = 0; i < 6; ++i) {
+        for (int j = i; j < 6; ++j) {
+            int64_t p[6], q[6];
+            int e[6], top = 0;
+            for (int row = 0; row < 6; ++row) {
+                const Z2 &x = entries[row][i], &y = entries[row][j];
+                p[row] = (int64_t) x.intPart * y.intPart + 2 * (int64_t) x.sqrt2Part * y.sqrt2Part;
+                q[row] = (int64_t) x.intPart * y.sqrt2Part + (int64_t) x.sqrt2Part * y.intPart;
+                e[row] = x.exponent + y.exponent;
+                top = std::max(top, e[row]);
+            }
+            int64_t P = 0, Q = 0;
+            for (int row = 0; row < 6; ++row) {
+                const int up = top - e[row];    // Multiply by sqrt(2)^up
+                int64_t a = p[row], b = q[row];
+                if (up & 1) std::tie(a, b) = std::make_pair(2 * b, a);
+                P += a << (up / 2);
+                Q += b << (up / 2);
+            }
+            // The dot product is (P + Q*sqrt(2))/sqrt(2)^top, which must be 1 on the diagonal and 0 off it
+            const int64_t P_one = i == j && top % 2 == 0 ? int64_t(1) << (top / 2) : 0;
+            const int64_t Q_one = i == j && top % 2 == 1 ? int64_t(1) << (top / 2) : 0;
+            if (P != P_one || Q != Q_one) return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a target from one line of a query file.
+ *
+ * A line is either a circuit, as the T matrix indices 0 to 14 separated by spaces, or the 36
+ * entries of a matrix row by row as printed by SO6's operator<<, each written a,bek for
+ * (a + b*sqrt(2))/sqrt(2)^k. Anything between the entries, such as the printed borders, is ignored.
+ * Every field must fit in a z2_int, every entry must be reduced, with a odd or the entry 0,0e0,
+ * and the matrix must be orthogonal.
+ *
+ * @param line The line to read.
+ * @param target Receives the target in canonical form.
+ * @return false if the line is neither, or its matrix is not a valid target.
+ */
+bool synth::parse(const std::string &line, SO6 &target) {
+    if (line.find(',') != std::string::npos) {
+        static const std::regex entry("(-?\\d+),(-?\\d+)e(-?\\d+)");
+        Z2 entries[6][6];
+        int n = 0;
+        for (auto it = std::sregex_iterator(line.begin(), line.end(), entry); it != std::sregex_iterator(); ++it, ++n) {
+            if (n == 36) return false;
+            z2_int a, b, k;
+            if (!parse_field((*it)[1], a) || !parse_field((*it)[2], b) || !parse_field((*it)[3], k)) return false;
+            if (a % 2 == 0 && !(a == 0 && b == 0 && k == 0)) return false;      // Not reduced
+            entries[n / 6][n % 6] = Z2(a, b, k);
+        }
+        if (n != 36 || !orthogonal(entries)) return false;
+        target = SO6(entries);
+        return true;
+    }
+    // Multiplying out the circuit and canonicalizing once is far cheaper than canonicalizing after every T matrix
+    static const std::vector<SO6> generators = [] {
+        std::vector<SO6> g;
+        for (int T = 0; T < bfs::GENERATORS; ++T) g.push_back(SO6::identity().left_multiply_by_T(T));
+        return g;
+    }();
+    std::istringstream gates(line);
+    SO6 S = SO6::identity();
+    for (std::string gate; gates >> gate; ) {
+        if (gate.find_first_not_of("0123456789") != std::string::npos || gate.size() > 2 || std::stoi(gate) >= bfs::GENERATORS) return false;
+        S = generators[std::stoi(gate)] * S;
+    }
+    Z2 entries[6][6];
+    for (int row = 0; row < 6; ++row)
+        for (int col = 0; col < 6; ++col) entries[row][col] = S.get_element(row, col);
+    target = SO6(entries);
+    return true;
+}
+
+/**
+ * @brief Keeps the layers from the identity up to a T count resident for every later query.
+ *
+ * Layers saved by an earlier call are loaded from LAYER_DIR as forward<T>. The rest are expanded and
+ * saved there, so the next process starts from the files.
+ *
+ * @param depth The largest T count to keep.
+ * @param use_files Whether to load and save the layers in LAYER_DIR.
+ */
+void synth::prepare(const int depth, const bool use_files) {
+    forward_layers.clear();
+    forward_index.clear();
+    for (int T = 0; T <= depth; ++T) {
+        const std::string name = "forward" + std::to_string(T);
+        packed_layer current;
+        if (T == 0) {
+            current.push_back(SO6::identity());
+        } else if (use_files && std::filesystem::exists(shard::layer_path(name))) {
+            current = shard::load_layer(name, false);
+            current.sort();
+        } else {
+            bfs::node_set next;
+            bfs::expand(forward_layers.back(), T > 1 ? forward_layers[T - 2] : packed_layer(), next, [](SO6 &) {}, [](size_t) {});
+            current = packed_layer(next.begin(), next.end());
+            if (use_files) shard::save_layer(name, bfs::layer{current});
+        }
+        forward_layers.push_back(std::move(current));
+    }
+    size_t total = 0;
+    for (const packed_layer &l : forward_layers) total += l.size();
+    forward_index.reserve(total);
+    for (uint32_t T = 0; T < forward_layers.size(); ++T)
+        for (uint32_t i = 0; i < forward_layers[T].size(); ++i) forward_index.emplace(forward_layers[T].fingerprint(i), std::make_pair(T, i));
+}
+
+/**
+ * @brief Finds a class held by both layers.
+ * @param forward A layer expanded from the identity.
+ * @param backward A layer expanded from the target.
+ * @param out Receives the first matrix of forward whose class is also in backward, with its history.
+ * @return Whether the layers meet.
+ */
+bool synth::meet(const packed_layer &forward, const packed_layer &backward, SO6 &out) {
+    const bool index_forward = forward.size() <= backward.size();
+    const packed_layer &indexed = index_forward ? forward : backward;
+    const packed_layer &probes = index_forward ? backward : forward;
+
+    std::unordered_multimap<uint64_t, uint32_t> by_fingerprint;
+    by_fingerprint.reserve(indexed.size());
+    for (size_t i = 0; i < indexed.size(); ++i) by_fingerprint.emplace(indexed.fingerprint(i), i);
+
+    std::atomic<size_t> first = forward.size();     // Least position in forward that meets, so the answer does not depend on scheduling
+    tbb::parallel_for(size_t(0), probes.size(), [&](const size_t p) {
+        auto [it, end] = by_fingerprint.equal_range(probes.fingerprint(p));
+        for (; it != end; ++it) {
+            if (indexed.compare(it->second, probes.matrix(p)) != 0) continue;     // Same fingerprint, different class
+            size_t position = index_forward ? it->second : p;
+            size_t seen = first.load();
+            while (position < seen && !first.compare_exchange_weak(seen, position)) {}
+        }
+    });
+    if (first == forward.size()) return false;
+    out = forward[first];
+    return true;
+}
+
+/**
+ * @brief Extends a circuit from the identity to the target.
+ * @param from A matrix in the last layer of backward, with the history of its circuit from the identity.
+ * @param backward The layers expanded from the target, the target alone first.
+ * @return The circuit of a matrix in the target's class.
+ */
+std::string synth::walk(SO6 from, const std::vector<packed_layer> &backward) {
+    for (int depth = (int) backward.size() - 2; depth >= 0; --depth) {
+        // Moves are symmetric, so some T matrix takes every class a distance depth + 1 from the target one step closer
+        for (int T = 0; T < bfs::GENERATORS; ++T) {
+            SO6 next = from.left_multiply_by_T(T);
+            if (backward[depth].contains(next)) {
+                from = next;
+                break;
+            }
+        }
+    }
+    return from.hist.empty() ? "" : from.circuit_string();
+}
+
+/**
+ * @brief Finds a circuit of least T count whose matrix is the target up to signed permutations.
+ * @param target The matrix to synthesize.
+ * @param max_T The largest T count to search.
+ * @return The circuit, or found == false if the target needs more than max_T T matrices.
+ */
+synth::result synth::query(const SO6 &target, const int max_T) {
+    if (resident_depth() >= 0) return query_resident(target, max_T);
+    const auto start = std::chrono::steady_clock::now();
+    result r;
+    packed_layer forward_prior, forward;
+    forward.push_back(SO6::identity());
+    SO6 root = target;
+    root.hist.clear();      // The target's own history plays no part in the circuit
+    std::vector<packed_layer> backward(1);
+    backward[0].push_back(root);
+    r.matrices = 2;
+
+    while (true) {
+        SO6 met;
+        if (meet(forward, backward.back(), met)) {
+            r.found = true;
+            r.T = r.forward_depth + r.backward_depth;
+            r.circuit = walk(met, backward);
+            break;
+        }
+        if (r.forward_depth + r.backward_depth >= max_T || forward.empty() || backward.back().empty()) break;
+
+        bfs::node_set next;
+        if (forward.size() <= backward.back().size()) {
+            bfs::expand(forward, forward_prior, next, [](SO6 &) {}, [](size_t) {});
+            bfs::advance(forward_prior, forward, next);
+            r.forward_depth++;
+            r.matrices += forward.size();
+        } else {
+            static const packed_layer none;
+            bfs::expand(backward.back(), backward.size() > 1 ? backward[backward.size() - 2] : none, next, [](SO6 &) {}, [](size_t) {});
+            backward.emplace_back(next.begin(), next.end());
+            r.backward_depth++;
+            r.matrices += backward.back().size();
+        }
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return r;
+}
+
+/**
+ * @brief Answers a query from the resident layers, expanding only the target's side.
+ *
+ * Every path of length at most b + resident_depth() passes through a class in a layer at most b
+ * from the target that is resident. So the first layer from the target that meets any resident
+ * layer gives the least T count, taking the nearest resident layer it meets.
+ */
+synth::result synth::query_resident(const SO6 &target, const int max_T) {
+    const auto start = std::chrono::steady_clock::now();
+    result r;
+    r.forward_depth = resident_depth();
+    SO6 root = target;
+    root.hist.clear();
+    std::vector<packed_layer> backward(1);
+    backward[0].push_back(root);
+    r.matrices = 1;
+
+    while (true) {
+        std::atomic<uint64_t> first = UINT64_MAX;     // Least (T count, position) of a resident match
+        const packed_layer &frontier = backward.back();
+        tbb::parallel_for(size_t(0), frontier.size(), [&](const size_t p) {
+            auto [it, end] = forward_index.equal_range(frontier.fingerprint(p));
+            for (; it != end; ++it) {
+                const auto [T, i] = it->second;
+                if (forward_layers[T].compare(i, frontier.matrix(p)) != 0) continue;
+                const uint64_t key = (uint64_t) T << 32 | i;
+                uint64_t seen = first.load();
+                while (key < seen && !first.compare_exchange_weak(seen, key)) {}
+            }
+        });
+        if (first != UINT64_MAX) {
+            const uint32_t T = first >> 32, i = first & 0xFFFFFFFF;
+            if ((int) T + r.backward_depth <= max_T) {
+                r.found = true;
+                r.T = T + r.backward_depth;
+                r.circuit = walk(forward_layers[T][i], backward);
+            }
+            break;
+        }
+        if (r.backward_depth + 1 > max_T || frontier.empty()) break;
+
+        bfs::node_set next;
+        static const packed_layer none;
+        bfs::expand(frontier, backward.size() > 1 ? backward[backward.size() - 2] : none, next, [](SO6 &) {}, [](size_t) {});
+        backward.emplace_back(next.begin(), next.end());
+        r.backward_depth++;
+        r.matrices += backward.back().size();
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return r;
+}
+
+std::string synth::describe(const result &r) {
+    std::ostringstream out;
+    if (r.found) out << "T=" << r.T << " circuit \"" << r.circuit << "\"";
+    else out << "not found up to T=" << r.forward_depth + r.backward_depth;
+    out << " in " << r.seconds * 1000 << "ms, " << r.matrices << " matrices (forward to T=" << r.forward_depth
+        << ", backward to T=" << r.backward_depth << ")";
+    return out.str();
+}
+
+/**
+ * @brief Answers every query in a file, one target per line. Empty lines and lines starting with # are skipped.
+ * @param path The query file.
+ * @param max_T The largest T count to search.
+ */
+void synth::run_file(const std::string &path, const int max_T) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "[Query] Could not open " << path << std::endl;
+        return;
+    }
+    std::string line;
+    for (int n = 1; getline(file, line); ++n) {
+        if (line.empty() || line[0] == '#') continue;
+        SO6 target;
+        if (!parse(line, target)) {
+            std::cerr << "[Query] Line " << n << ": not a circuit or a matrix" << std::endl;
+            continue;
+        }
+        std::cout << "[Query] Line " << n << ": " << describe(query(target, max_T)) << std::endl;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef SYNTH_HPP
+#define SYNTH_HPP
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "SO6.hpp"
+#include "packed_layer.hpp"
+
+/**
+ * @file synth.hpp
+ * @brief Minimal T count circuits for given matrices by meeting in the middle.
+ *
+ * Matrices are stored up to signed permutations of their rows and columns, and conjugating a T
+ * matrix by a signed permutation gives another T matrix or its inverse. Since the inverse of a T
+ * matrix, its transpose, is a T matrix times a signed permutation, left multiplying by the 15 T
+ * matrices moves between the same classes in both directions. So the classes a distance b from a
+ * target are found by expanding the target itself, exactly as the layers a distance a from the
+ * identity are found by expanding the identity.
+ *
+ * A query expands whichever of the two frontiers is smaller and looks up the new layer in the
+ * other side's last layer by fingerprint. The first class found in both has a T count of a + b,
+ * the least possible, after about the work of two searches of half that depth. Its circuit is the
+ * forward matrix's history, extended by stepping back through the target's layers one T matrix at
+ * a time.
+ *
+ * A long running process calls prepare() once to keep the layers from the identity resident,
+ * indexed by fingerprint. Queries then only expand the target's side and look up each of its layers
+ * in every resident layer at once.
+ */
+class synth {
+public:
+    struct result {
+        bool found = false;
+        int T = -1;
+        std::string circuit;
+        int forward_depth = 0;      // Depth of the last layer expanded from the identity
+        int backward_depth = 0;     // Depth of the last layer expanded from the target
+        uint64_t matrices = 0;      // Matrices in every layer the query expanded
+        double seconds = 0;
+    };
+
+    static bool parse(const std::string &line, SO6 &target);
+    static void prepare(const int depth, const bool use_files);
+    static void release() { forward_layers.clear(); forward_index.clear(); }
+    static int resident_depth() { return (int) forward_layers.size() - 1; }
+    static result query(const SO6 &target, const int max_T);
+    static void run_file(const std::string &path, const int max_T);
+    static std::string describe(const result &r);
+
+private:
+    static std::vector<packed_layer> forward_layers;        // Resident layers from the identity, by T count
+    static std::unordered_multimap<uint64_t, std::pair<uint32_t, uint32_t>> forward_index;     // Fingerprint to layer and position
+
+    static result query_resident(const SO6 &target, const int max_T);
+    static bool meet(const packed_layer &forward, const packed_layer &backward, SO6 &out);
+    static std::string walk(SO6 from, const std::vector<packed_layer> &backward);
+};
+
+#endif // SYNTH_HPP
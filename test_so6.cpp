@@ -1,9 +1,11 @@
 // #include <gtest/gtest.h>      // Google Test framework
 #include <algorithm>          // For std::shuffle
 #include <random>             // For generating random numbers
+#include <numeric>            // For std::iota
 #include <set>
 #include <chrono>
 #include <optional>           // For std::optional
+#include <functional>
 #include "SO6.hpp"            // Include SO6 header
 #include "Z2.hpp"             // Include Z2 header
 #include "utils.hpp"
@@ -12,11 +14,36 @@
 #include <iomanip>            // For std::setw, std::setfill
 #include <cassert>            // For assert // For tbb::concurrent_set
 #include "uint72_t.hpp"
+#include "pattern_io.hpp"
+#include "bfs.hpp"
+#include "pipeline.hpp"
+#include "result_writer.hpp"
+#include "circuit_io.hpp"
+#include "block_codec.hpp"
+#include "shard.hpp"
+#include "run_stats.hpp"
+#include "balance.hpp"
+#include "tiling.hpp"
+#include "join.hpp"
+#include "synth.hpp"
+#include "server.hpp"
+#include "symmetry.hpp"
+#include "layer_arena.hpp"
+#include "memory.hpp"
+#include "budget.hpp"
+#include "coverage.hpp"
+#include <filesystem>
+#include <map>
+#include <fstream>
 
 #include <iostream>
 #include <bitset>
 #include <array>
 #include <cstdint>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
 #include "uint72_t.hpp" // Assuming your uint72_t implementation is in this file
 
 // Function to generate a row mask
@@ -55,6 +82,27 @@ void print_test(const std::string& test_name, bool result) {
     assert(result && "Test failed! Check your implementation.");
 }
 
+/**
+ * @brief The BFS layers from the identity, layer T at index T for T = 0 to depth.
+ * @param on_new Called with every new matrix, as bfs::expand calls it.
+ * @param next The set each layer is built in, so a test can draw it from an arena.
+ * @param built Called with each layer's set once it is built, before it is packed.
+ */
+std::vector<packed_layer> build_layers(const int depth, const std::function<void(SO6 &)> &on_new = [](SO6 &) {}, bfs::node_set next = {},
+                                       const std::function<void(const bfs::node_set &)> &built = [](const bfs::node_set &) {}) {
+    std::vector<packed_layer> layers;
+    packed_layer prior, current;
+    current.push_back(SO6::identity());
+    for (int T = 0; T < depth; ++T) {
+        layers.push_back(current);
+        bfs::expand(current, prior, next, on_new, [](size_t) {});
+        built(next);
+        bfs::advance(prior, current, next);
+    }
+    layers.push_back(current);
+    return layers;
+}
+
 void test_uint72_t() {
     std::cout << "Testing uint72_t...\n";
 
@@ -142,6 +190,912 @@ void test_uint72_t() {
 }
 
 
+// Random pattern with every cell drawn from {0,1,2,3}
+pattern rand_pattern(std::mt19937_64 &g) {
+    pattern ret;
+    uint64_t bits = g();
+    ret.pattern_data = uint72_t(bits, static_cast<uint8_t>(g()));
+    return ret;
+}
+
+void test_pattern_transforms() {
+    std::cout << "Testing pattern transforms...\n";
+    std::mt19937_64 g(12345);
+
+    bool mods_pass = true, mod_all_pass = true, rows_pass = true, cols_pass = true;
+    for (int trial = 0; trial < 64; ++trial) {
+        pattern p = rand_pattern(g);
+
+        // Cell-by-cell reference for every combination of row mods
+        for (int rows = 0; rows < 64; ++rows) {
+            pattern expected = p;
+            for (int r = 0; r < 6; ++r) {
+                if (!((rows >> r) & 1)) continue;
+                for (int c = 0; c < 6; ++c) {
+                    uint8_t value = expected.get_val(r, c);
+                    if (value >= 2) expected.set(r, c, value ^ 1);
+                }
+            }
+            pattern actual = p;
+            actual.mod_rows(rows);
+            mods_pass &= (actual.pattern_data == expected.pattern_data);
+        }
+
+        pattern all_rows = p;
+        all_rows.mod_rows(0x3F);
+        mod_all_pass &= (p.pattern_mod().pattern_data == all_rows.pattern_data);
+
+        // Every row and column permutation against get/set
+        int perm[6] = {0, 1, 2, 3, 4, 5};
+        do {
+            pattern by_row = p.permute_rows(perm);
+            pattern by_col = p.permute_cols(perm);
+            for (int r = 0; r < 6; ++r) for (int c = 0; c < 6; ++c) {
+                rows_pass &= (by_row.get_val(r, c) == p.get_val(perm[r], c));
+                cols_pass &= (by_col.get_val(r, c) == p.get_val(r, perm[c]));
+            }
+        } while (std::next_permutation(perm, perm + 6));
+    }
+
+    print_test("Row Mods", mods_pass);
+    print_test("Pattern Mod", mod_all_pass);
+    print_test("Row Permutations", rows_pass);
+    print_test("Column Permutations", cols_pass);
+}
+
+void test_incremental_pattern() {
+    std::cout << "Testing incremental LDE and pattern...\n";
+    std::mt19937 g(4321);
+    bool lde_pass = true, pattern_pass = true;
+    for (int walk = 0; walk < 200; ++walk) {
+        SO6 s = SO6::identity();
+        for (int step = 0; step < 12; ++step) {
+            s = s.left_multiply_by_T(g() % 15);
+
+            // A fresh copy of the entries has no cached state and rebuilds it from scratch
+            SO6 fresh;
+            std::copy(s.arr, s.arr + 36, fresh.arr);
+            lde_pass &= (s.getLDE() == fresh.getLDE());
+            pattern_pass &= (s.pattern_bits() == fresh.to_pattern().pattern_data);
+        }
+    }
+    print_test("Incremental LDE", lde_pass);
+    print_test("Incremental Pattern", pattern_pass);
+}
+
+void test_pattern_io() {
+    std::cout << "Testing pattern file formats...\n";
+    std::mt19937_64 g(777);
+    bool round_trip = true;
+    unsigned char record[pattern_io::RECORD_SIZE];
+    for (int trial = 0; trial < 1000; ++trial) {
+        pattern p = rand_pattern(g);
+        pattern_io::encode(p, record);
+        round_trip &= (pattern_io::decode(record).pattern_data == p.pattern_data);
+    }
+    print_test("Binary Record Round Trip", round_trip);
+
+    // The same pattern as a binary string and as CSV entries
+    pattern p = rand_pattern(g);
+    std::string binary_line, csv_line;
+    for (int i = 0; i < 36; ++i) {
+        uint8_t value = p.pattern_data.get_pair(2 * i);
+        binary_line += std::to_string(value >> 1) + std::to_string(value & 1);
+        csv_line += std::to_string(value) + (i < 35 ? "," : "");
+    }
+    print_test("Parse Binary Line", pattern_io::parse_line(binary_line + "\r").pattern_data == p.pattern_data);
+    print_test("Parse CSV Line", pattern_io::parse_line(csv_line).pattern_data == p.pattern_data);
+
+    int rejected = 0;
+    for (const std::string &bad : {binary_line.substr(1), binary_line.substr(1) + "2", csv_line + ",1", std::string("4") + csv_line.substr(1)}) {
+        try { pattern_io::parse_line(bad); } catch (const std::invalid_argument &) { ++rejected; }
+    }
+    print_test("Reject Malformed Lines", rejected == 4);
+    print_test("Identity Well Formed", pattern::identity().is_well_formed());
+
+    // A record count whose size in bytes wraps around to the one byte that follows the header
+    const uint64_t wrapping = 0x8e38e38e38e38e39;     // Times RECORD_SIZE is 1 mod 2^64
+    std::string header(pattern_io::MAGIC, 4);
+    header += std::string{(char) pattern_io::VERSION, 0, (char) pattern_io::RECORD_SIZE, 0};
+    for (int i = 0; i < 8; ++i) header += (char) (wrapping >> (8 * i));
+    const std::string path = "/tmp/test_pattern_io.bin";
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << header << '\0';
+    tbb::concurrent_set<pattern> targets;
+    const pattern_io::load_result wrapped = pattern_io::read_binary(path, targets, 2);
+    print_test("Reject Wrapping Record Count", wrapping * pattern_io::RECORD_SIZE == 1 && wrapped.read == 0 && targets.empty());
+}
+
+// Entry-by-entry classification following the case_num() documentation
+uint8_t reference_case_num(const pattern &p) {
+    int col_ones[6] = {0}, row_ones[6] = {0}, weight = 0;
+    for (int r = 0; r < 6; ++r) for (int c = 0; c < 6; ++c) {
+        int one = p.get_val(r, c) >> 1;
+        col_ones[c] += one;
+        row_ones[r] += one;
+        weight += one;
+    }
+    switch (weight) {
+        case 4: return 1;
+        case 24: return 8;
+        case 16:
+            for (int k = 0; k < 3; ++k) if (col_ones[k] == 2 || row_ones[k] == 2) return 6;
+            return 3;
+        case 12:
+            for (int k = 0; k < 3; ++k) if (col_ones[k] == 4 || col_ones[k] == 0) return 4;
+            return 7;
+        case 8: {
+            int zero_cols = 0, zero_rows = 0;
+            for (int k = 0; k < 4; ++k) {
+                if (col_ones[k] == 4 || row_ones[k] == 4) return 2;
+                zero_cols += col_ones[k] == 0;
+                zero_rows += row_ones[k] == 0;
+            }
+            return (zero_cols > 2 || zero_rows > 2) ? 2 : 5;
+        }
+        default: return 0;
+    }
+}
+
+void test_batch_case_num() {
+    std::cout << "Testing batch case numbers...\n";
+    std::mt19937_64 g(99);
+    const int weights[] = {4, 8, 12, 16, 24, 6, 10};
+    std::vector<pattern> patterns;
+    for (int trial = 0; trial < 20000; ++trial) {
+        // Integer bits at a random set of entries of a fixed weight, random sqrt(2) bits
+        pattern p = rand_pattern(g);
+        int cells[36];
+        std::iota(cells, cells + 36, 0);
+        std::shuffle(cells, cells + 36, g);
+        for (int i = 0; i < 36; ++i) {
+            const int row = cells[i] % 6, col = cells[i] / 6;
+            p.set(row, col, static_cast<uint8_t>(((i < weights[trial % 7]) << 1) | (p.get_val(row, col) & 1)));
+        }
+        patterns.push_back(p);
+    }
+
+    std::vector<uint72_t> data;
+    for (const pattern &p : patterns) data.push_back(p.pattern_data);
+    std::vector<uint8_t> cases(data.size());
+    pattern::case_nums(data.data(), data.size(), cases.data());
+
+    bool scalar_pass = true, batch_pass = true;
+    int seen = 0;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        const uint8_t expected = reference_case_num(patterns[i]);
+        scalar_pass &= (patterns[i].case_num() == expected);
+        batch_pass &= (cases[i] == expected);
+        seen |= 1 << expected;
+    }
+    print_test("Scalar Case Numbers", scalar_pass);
+    print_test("Batch Case Numbers", batch_pass);
+    print_test("Every Case Exercised", seen == 0x1FF);
+}
+
+void test_bfs() {
+    std::cout << "Testing work-stealing BFS...\n";
+    const size_t expected[] = {2, 6, 19, 77, 371};   // New matrices at T=2 through T=6
+    bool counts = true, sorted = true;
+    std::atomic<uint64_t> found = 0;
+    const std::vector<packed_layer> layers = build_layers(6, [&](SO6 &) { ++found; }, {}, [&](const bfs::node_set &next) {
+        counts &= found == next.size();
+        found = 0;
+    });
+    for (int T = 1; T <= 6; ++T) {
+        if (T > 1) counts &= layers[T].size() == expected[T - 2];
+        for (size_t i = 1; i < layers[T].size(); ++i) sorted &= layers[T].compare(i, layers[T].matrix(i - 1)) > 0;
+    }
+    print_test("BFS Layer Sizes", counts);
+    print_test("BFS Layers Sorted", sorted);
+
+    // Equal matrices must meet in one shard, so sharded layers have the same sizes
+    numa::configure_unpinned(3, 3);
+    bfs::layer prior_shards(numa::shards()), current_shards = bfs::root_layer(SO6::identity());
+    bfs::next_layer next_shards(numa::shards());
+    bool sharded_counts = true, routed = true;
+    for (int T = 1; T <= 6; ++T) {
+        bfs::expand(current_shards, prior_shards, next_shards, [](SO6 &) {}, [](size_t) {});
+        bfs::advance(prior_shards, current_shards, next_shards);
+        if (T > 1) sharded_counts &= (bfs::size(current_shards) == expected[T - 2]);
+        for (size_t k = 0; k < numa::shards(); ++k)
+            for (const SO6 &S : current_shards[k]) routed &= (numa::shard_of(S) == k);
+    }
+    numa::reset();
+    print_test("Sharded BFS Layer Sizes", sharded_counts);
+    print_test("Matrices Routed To Their Shard", routed);
+}
+
+void test_result_writer() {
+    std::cout << "Testing asynchronous result writer...\n";
+    std::mt19937 g(99);
+    std::vector<SO6> circuits;
+    for (int walk = 0; walk < 8000; ++walk) {     // Enough text to hand off several blocks
+        SO6 s = SO6::identity();
+        for (int step = 0, length = 1 + g() % 12; step < length; ++step) s = s.left_multiply_by_T(g() % 15);
+        circuits.push_back(s);
+    }
+    for (size_t i = 0; i < 2000; ++i) circuits.push_back(circuits[2 * i] * circuits[2 * i + 1]);     // Histories joined mid-byte when the right factor is odd
+    const std::string text_path = "/tmp/test_result_writer.dat", binary_path = "/tmp/test_result_writer.bin";
+    {
+        result_writer text(text_path), binary(binary_path, result_writer::BINARY);
+        tbb::parallel_for(size_t(0), circuits.size(), [&](const size_t i) {
+            text.record(circuits[i]);
+            binary.record(circuits[i]);
+        });
+    }   // Closing drains every buffer
+
+    std::multiset<std::string> expected, lines;
+    for (SO6 &s : circuits) expected.insert(s.circuit_string());
+    std::ifstream text_in(text_path);
+    for (std::string line; std::getline(text_in, line); ) lines.insert(line);
+    print_test("Text Records Match circuit_string", lines == expected);
+
+    std::ifstream binary_in(binary_path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(binary_in)), std::istreambuf_iterator<char>());
+    bool header = bytes.compare(0, 4, result_writer::MAGIC, 4) == 0;
+    std::multiset<std::string> decoded;
+    for (size_t pos = result_writer::HEADER_SIZE; pos < bytes.size(); ) {
+        const size_t gates = static_cast<uint8_t>(bytes[pos++]);
+        SO6 s;
+        s.hist.assign(bytes.begin() + pos, bytes.begin() + pos + (gates + 1) / 2);
+        pos += (gates + 1) / 2;
+        decoded.insert(s.circuit_string());
+    }
+    print_test("Binary Records Match History", header && decoded == expected);
+
+    const SO6 odd = SO6::identity().left_multiply_by_T(0), pair = SO6::identity().left_multiply_by_T(3).left_multiply_by_T(7);
+    std::string record;
+    result_writer::append_binary(record, (pair * odd).hist);     // History bytes 01 84, with an unused nibble between the factors
+    print_test("Binary Records Repack Products", record == std::string("\x03\x41\x08", 3));
+    std::remove(text_path.c_str());
+    std::remove(binary_path.c_str());
+}
+
+void test_circuit_io() {
+    std::cout << "Testing circuit file reading and conversion...\n";
+    std::vector<unsigned char> hist;
+    const bool parsed = circuit_io::parse_line("14 0 3\r", hist) && hist == std::vector<unsigned char>{0x1F, 0x04} && circuit_io::gates(hist) == 3
+                        && circuit_io::parse_line("", hist) && hist.empty();
+    print_test("Circuit Lines Parse To History", parsed && !circuit_io::parse_line("15", hist) && !circuit_io::parse_line("1,2", hist));
+
+    std::mt19937 g(7);
+    std::vector<SO6> circuits;
+    for (int walk = 0; walk < 2000; ++walk) {
+        SO6 s = SO6::identity();
+        for (int step = 0, length = g() % 13; step < length; ++step) s = s.left_multiply_by_T(g() % 15);
+        circuits.push_back(s);
+    }
+    const std::string text_path = "/tmp/test_circuit_io.dat", binary_path = "/tmp/test_circuit_io.bin", back_path = "/tmp/test_circuit_io.txt";
+    {
+        result_writer text(text_path);
+        for (const SO6 &s : circuits) text.record(s);
+    }
+    std::ofstream(text_path, std::ios::app) << "3 x 4\n";   // One malformed line
+
+    size_t i = 0;
+    bool replayed = true;
+    const circuit_io::load_result text = circuit_io::read(text_path, [&](const std::vector<unsigned char> &h) {
+        replayed &= h == circuits[i].hist && (circuit_io::replay(h) <=> circuits[i]) == 0;
+        ++i;
+    });
+    print_test("Text Circuit File Replays", replayed && text.format == result_writer::TEXT && text.read == circuits.size() && text.malformed == 1);
+
+    const circuit_io::load_result to_binary = circuit_io::convert(text_path, binary_path, result_writer::BINARY);
+    const circuit_io::load_result to_text = circuit_io::convert(binary_path, back_path, result_writer::TEXT);
+    std::vector<std::vector<unsigned char>> read_back;
+    const circuit_io::load_result binary = circuit_io::read(binary_path, [&](const std::vector<unsigned char> &h) { read_back.push_back(h); });
+    bool same = binary.format == result_writer::BINARY && read_back.size() == circuits.size();
+    for (size_t k = 0; same && k < circuits.size(); ++k) same = read_back[k] == circuits[k].hist;
+    print_test("Circuit Files Convert To Binary", circuit_io::format_of(binary_path) == result_writer::BINARY && to_binary.read == circuits.size() && to_binary.malformed == 1 && same);
+
+    std::ifstream original(text_path), converted(back_path);
+    std::string a((std::istreambuf_iterator<char>(original)), std::istreambuf_iterator<char>());
+    std::string b((std::istreambuf_iterator<char>(converted)), std::istreambuf_iterator<char>());
+    print_test("Circuit Files Convert Back To Text", to_text.read == circuits.size() && a == b + "3 x 4\n");
+
+    std::filesystem::resize_file(binary_path, std::filesystem::file_size(binary_path) - 1);
+    const circuit_io::load_result truncated = circuit_io::read(binary_path, [](const std::vector<unsigned char> &) {});
+    print_test("Truncated Binary Record Rejected", truncated.malformed == 1 && truncated.read + 1 >= circuits.size());
+
+    // Free multiply products G * S, whose histories join mid-byte when S has an odd gate count
+    std::vector<SO6> products;
+    for (size_t i = 0; i < circuits.size(); ++i)
+        if (circuit_io::gates(circuits[i].hist) % 2 == 1) products.push_back(circuits[(i + 1) % circuits.size()] * circuits[i]);
+    const std::string products_path = "/tmp/test_circuit_io.products";
+    bool products_round_trip = true;
+    for (const result_writer::format f : {result_writer::TEXT, result_writer::BINARY, result_writer::COMPRESSED}) {
+        {
+            result_writer out(products_path, f);
+            for (const SO6 &p : products) out.record(p);
+        }
+        size_t k = 0;
+        const circuit_io::load_result r = circuit_io::read(products_path, [&](const std::vector<unsigned char> &h) {
+            if (k >= products.size()) return (void) (products_round_trip = false);
+            SO6 read_back = circuit_io::replay(h), product = circuit_io::replay(products[k].hist);
+            products_round_trip &= circuit_io::gates(h) == circuit_io::gates(products[k].hist) && read_back.circuit_string() == products[k].circuit_string();
+            for (int row = 0; row < 6; ++row)
+                for (int col = 0; col < 6; ++col) products_round_trip &= read_back.get_element(row, col) == product.get_element(row, col);
+            ++k;
+        });
+        products_round_trip &= r.format == f && r.read == products.size() && r.malformed == 0;
+    }
+    print_test("Products Of Odd Circuits Round Trip", products_round_trip);
+
+    // A zero nibble before the last gate is a writer bug, not a record to repair
+    std::ofstream(products_path, std::ios::binary | std::ios::trunc) << std::string(result_writer::MAGIC, 4) << std::string("\x01\0\0\0\x04\x01\x84\x03\x41\x08", 10);
+    std::vector<unsigned char> packed;
+    const circuit_io::load_result gapped = circuit_io::read(products_path, [&](const std::vector<unsigned char> &h) { packed = h; });
+    print_test("Records With Unused Nibbles Rejected", gapped.read == 1 && gapped.malformed == 1 && packed == std::vector<unsigned char>{0x41, 0x08});
+
+    const std::string compressed_path = "/tmp/test_circuit_io.z";
+    {
+        result_writer compressed(compressed_path, result_writer::COMPRESSED);
+        tbb::parallel_for(size_t(0), size_t(20), [&](const size_t) {     // Enough to hand off several blocks from several threads
+            for (const SO6 &s : circuits) compressed.record(s);
+        });
+    }
+    std::map<std::vector<unsigned char>, int> expected, decoded;
+    for (const SO6 &s : circuits) expected[s.hist] += 20;
+    const circuit_io::load_result z = circuit_io::read(compressed_path, [&](const std::vector<unsigned char> &h) { ++decoded[h]; });
+    print_test("Compressed Circuit File Reads Back", z.format == result_writer::COMPRESSED && z.malformed == 0 && decoded == expected
+                                                     && std::filesystem::file_size(compressed_path) < 20 * std::filesystem::file_size(binary_path));
+
+    // Every block decodes on its own, so a corrupt block loses only its own records
+    std::fstream damage(compressed_path, std::ios::in | std::ios::out | std::ios::binary);
+    damage.seekg(result_writer::HEADER_SIZE);
+    const char length_byte = damage.get();
+    damage.seekp(result_writer::HEADER_SIZE);
+    damage.put(length_byte ^ 1);       // The first block no longer decodes to its length
+    damage.close();
+    uint64_t after_damage = 0;
+    const circuit_io::load_result damaged = circuit_io::read(compressed_path, [&](const std::vector<unsigned char> &) { ++after_damage; });
+    print_test("Compressed Blocks Decode Independently", damaged.malformed == 1 && after_damage > 0 && after_damage < 20 * circuits.size());
+    for (const std::string &path : {text_path, binary_path, back_path, products_path, compressed_path}) std::remove(path.c_str());
+}
+
+void test_block_codec() {
+    std::cout << "Testing block codec...\n";
+    std::mt19937 g(11);
+    std::string noise(70000, 0), runs, packed, unpacked;
+    for (char &c : noise) c = static_cast<char>(g());
+    for (int i = 0; i < 5000; ++i) runs += std::string(1 + g() % 40, 'a' + g() % 3) + "0 1 14 7 ";
+    bool round_trips = true;
+    for (const std::string &block : {std::string(), std::string("abc"), std::string(100000, 'x'), noise, runs}) {
+        block_codec::compress(block.data(), block.size(), packed);
+        round_trips &= block_codec::decompress(packed.data(), packed.size(), block.size(), unpacked) && unpacked == block;
+    }
+    print_test("Block Codec Round Trips", round_trips);
+    block_codec::compress(runs.data(), runs.size(), packed);
+    print_test("Block Codec Compresses Repeats", packed.size() * 4 < runs.size());
+
+    bool rejected = true;
+    for (size_t cut = 0; cut < packed.size(); cut += 97) rejected &= !block_codec::decompress(packed.data(), cut, runs.size(), unpacked);
+    rejected &= !block_codec::decompress(packed.data(), packed.size(), runs.size() - 1, unpacked);
+    print_test("Block Codec Rejects Truncated Blocks", rejected);
+}
+
+void test_shard() {
+    std::cout << "Testing shard slices and coverage merge...\n";
+    bool partition = true;
+    for (int n = 1; n <= 4; ++n) {
+        std::vector<int> owners(50, 0);
+        for (int i = 0; i < n; ++i) {
+            shard::configure(std::to_string(i) + "/" + std::to_string(n));
+            for (size_t position = 0; position < owners.size(); ++position) owners[position] += shard::owns(position);
+        }
+        partition &= std::all_of(owners.begin(), owners.end(), [](const int c) { return c == 1; });
+    }
+    bool rejects = true;
+    for (const std::string spec : {"3/3", "-1/2", "2", "1/0"}) {
+        try {
+            shard::configure(spec);
+            rejects = false;
+        } catch (const std::exception &) {}
+    }
+    shard::reset();
+    print_test("Shards Partition Positions", partition);
+    print_test("Invalid Shard Rejected", rejects);
+
+    const std::string path = "/tmp/test_shard_coverage";
+    std::ofstream(path) << "3 7\n5 6\n3 5\n";
+    tbb::concurrent_set<pattern> none;
+    coverage::begin(none);
+    bool merged = coverage::merge(path);
+    coverage::save(path);
+    std::ifstream in(path);     // Saved cases are sorted and keep the lowest T of each
+    std::string saved((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    print_test("Coverage Merge Keeps Lowest T", merged && saved == "3 5\n5 6\n");
+    std::remove(path.c_str());
+    coverage::begin(none);
+}
+
+void test_pipeline() {
+    std::cout << "Testing pipelined BFS...\n";
+    pipeline::configure("2,1,1", 2);
+    const std::vector<packed_layer> reference = build_layers(6);
+    packed_layer prior, current;
+    current.push_back(SO6::identity());
+    bfs::node_set next;
+    bool same_layers = true;
+    uint64_t expanded = 0, children = 0;
+    for (int T = 1; T <= 6; ++T) {
+        expanded += current.size();
+        for (const SO6 &S : current) children += 15 - __builtin_popcount(bfs::skipped(S, S));     // Skipped children are never formed
+        pipeline::expand(current, prior, next, [](SO6 &) { return false; }, [](SO6 &) {});
+        bfs::advance(prior, current, next);
+        same_layers &= (current.size() == reference[T].size());
+        for (size_t i = 0; same_layers && i < current.size(); ++i) same_layers &= ((current.matrix(i) <=> reference[T].matrix(i)) == 0);
+    }
+    const pipeline::stage_stats &e = pipeline::stats(pipeline::EXPAND);
+    print_test("Pipeline Layers Match BFS", same_layers);
+    print_test("Pipeline Stage Counters", e.items_in == expanded && e.items_out == children
+                                              && pipeline::stats(pipeline::DEDUP).items_in == e.items_out);
+}
+
+void test_run_stats() {
+    std::cout << "Testing run stats...\n";
+    run_stats::reset();
+    const std::string path = "test_run_stats.json";
+    run_stats::start(path, 60, true);
+    run_stats::begin_layer(3, "bfs", 1000);
+    tbb::parallel_for(0, 1000, [](const int i) {
+        run_stats::work_done();
+        run_stats::children(15);
+        for (int T = 0; T < 15; ++T) (i + T) % 3 ? run_stats::dedup_hit() : run_stats::new_node();
+    });
+    const run_stats::totals t = run_stats::sum();
+    print_test("Run Stats Counts Every Thread", t.work == 1000 && t.children == 15000 && t.dedup_hits + t.new_nodes == 15000);
+
+    run_stats::end_layer();
+    run_stats::record_layer(3, 6, 6 * sizeof(SO6));
+    run_stats::stop();      // Writes the file one last time
+    std::ifstream in(path);
+    const std::string written((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    bool fields = true;
+    for (const char *key : {"\"nodes_per_s\"", "\"dedup_hit_rate\"", "\"patterns_remaining\"", "\"eta_s\"", "\"layers\": [{\"T\": 3, \"matrices\": 6"})
+        fields &= written.find(key) != std::string::npos;
+    print_test("Run Stats JSON File", fields && written.find("\"work_done\": 1000") != std::string::npos);
+    print_test("Run Stats Plain Log", std::string(run_stats::rewind(2)).empty());
+    std::remove(path.c_str());
+    run_stats::reset();
+}
+
+void test_balance() {
+    std::cout << "Testing cost-aware chunking...\n";
+    packed_layer items;
+    SO6 walk = SO6::identity();
+    items.push_back(walk);
+    for (int i = 0; i < 500; ++i) {     // Denser as the circuit grows
+        walk = walk.left_multiply_by_T(i % 15);
+        walk.hist.clear();      // Longer than a packed record holds, and the cost only depends on the entries
+        items.push_back(walk);
+    }
+    uint64_t total = 0, heaviest = 0;
+    for (const SO6 &S : items) {
+        total += balance::cost(S);
+        heaviest = std::max<uint64_t>(heaviest, balance::cost(S));
+    }
+
+    const size_t n = 16;
+    const std::vector<size_t> bounds = balance::chunks(items, n);
+    bool ordered = bounds.front() == 0 && bounds.back() == items.size() && bounds.size() == n + 1;
+    bool even = true;
+    for (size_t c = 0; c + 1 < bounds.size(); ++c) {
+        ordered &= bounds[c] < bounds[c + 1];
+        uint64_t chunk = 0;
+        for (size_t i = bounds[c]; i < bounds[c + 1]; ++i) chunk += balance::cost(items.matrix(i));
+        even &= chunk <= total / n + heaviest;
+    }
+    print_test("Balance Chunks Cover Items", ordered);
+    print_test("Balance Chunks Equal Cost", even && balance::cost(items.matrix(items.size() - 1)) > balance::cost(items.matrix(0)));
+
+    std::vector<std::atomic<int>> visits(items.size());
+    balance::run(items, [&](const size_t i) { visits[i]++; });
+    print_test("Balance Runs Every Item Once", std::all_of(visits.begin(), visits.end(), [](const std::atomic<int> &v) { return v == 1; }));
+    balance::reset();
+}
+
+void test_tiling() {
+    std::cout << "Testing tiled products...\n";
+    SO6 S = SO6::identity();
+    for (int g : {3, 7, 1, 12, 0, 9, 4}) S = S.left_multiply_by_T(g);
+    bool same = true;
+    for (int i = 0; i < 15; ++i) {
+        const SO6 P = SO6::identity().left_multiply_by_T(i) * S, Q = S.left_multiply_by_T(i);
+        for (int r = 0; r < 6; ++r)
+            for (int c = 0; c < 6; ++c) same &= P.get_element(r, c) == Q.get_element(r, c);
+    }
+    print_test("Product Matches Gate Replay", same);
+
+    const size_t stored = 37, generators = 1000;
+    std::vector<int> visits(stored * generators, 0);
+    tiling::for_each_tile(stored, generators, {64, 5}, [&](const size_t i, const size_t g_begin, const size_t g_end) {
+        for (size_t g = g_begin; g < g_end; ++g) visits[i * generators + g]++;
+    });
+    print_test("Tiles Cover Every Product Once", std::all_of(visits.begin(), visits.end(), [](const int v) { return v == 1; }));
+
+    const size_t bytes = 88;    // A packed record at T=7
+    const std::vector<tiling::shape> shapes = tiling::candidates({32 << 10, 1 << 20, 8 << 20}, 100000, bytes);
+    print_test("Tile Candidates Fit Caches", shapes.size() > 2 && shapes[0].generators == 100000
+                                            && shapes[1].generators * bytes <= (1 << 19) && shapes[1].stored * bytes <= (16 << 10));
+}
+
+void test_join() {
+    std::cout << "Testing targeted join...\n";
+    const std::vector<packed_layer> layers = build_layers(5);
+    const packed_layer &G = layers[3], &S = layers[5];
+    const join::index gi = join::build(G), si = join::build(S);
+
+    bool patterns_match = true, cases_match = true;
+    size_t from_residues = 0;
+    for (size_t g = 0; g < G.size(); ++g) {
+        for (size_t s = 0; s < S.size(); ++s) {
+            const uint72_t real = (G[g] * S[s]).pattern_bits();
+            const uint64_t product = join::int_product(join::int_bits(G[g].pattern_bits()), join::int_bits(S[s].pattern_bits()));
+            if (product != 0) cases_match &= product == join::int_bits(real) && join::int_case(product) == pattern(real.low_bits, real.high_bits).case_num();
+            uint72_t bits;
+            if (!join::product_pattern(gi.residues[g], si.residues[s], bits)) continue;
+            from_residues++;
+            patterns_match &= bits.low_bits == real.low_bits && bits.high_bits == real.high_bits;
+        }
+    }
+    print_test("Integer Bits Fix Product Case", cases_match);
+    print_test("Residues Fix Product Pattern", patterns_match && from_residues > 0);
+
+    // Every product whose case is wanted must be handed to record, and nothing else of a skipped case
+    const uint8_t target = (G[1] * S[S.size() / 2]).to_pattern().case_num();
+    std::set<std::pair<uint32_t, uint32_t>> recorded;
+    size_t formed = 0;
+    for (size_t b = 0; b < gi.buckets.size(); ++b)
+        join::probe(gi, si, b, [&](const uint8_t c) { return c == target; }, [&](const uint32_t g, const uint32_t s) {
+            recorded.insert({g, s});
+            formed++;
+        });
+    bool complete = true;
+    for (size_t g = 0; g < G.size(); ++g)
+        for (size_t s = 0; s < S.size(); ++s)
+            if ((G[g] * S[s]).to_pattern().case_num() == target) complete &= recorded.count({(uint32_t) g, (uint32_t) s}) == 1;
+    print_test("Join Finds Every Target Product", complete && formed < G.size() * S.size());
+
+    // Found cases clear one at a time; the join takes over once at most the threshold remain
+    bool switches = !join::targeted(coverage::ALL_CASES, 2) && !join::targeted(coverage::ALL_CASES, 0) && !join::targeted(0, 2);
+    uint16_t remaining = coverage::ALL_CASES;
+    for (int found = 1; found <= 8; ++found) {
+        remaining &= ~(1 << found);
+        switches &= join::targeted(remaining, 2) == (found >= 6 && found < 8) && join::targeted(remaining, 8) == (found < 8);
+    }
+    print_test("Join Switches On At Threshold", switches);
+    join::reset();
+}
+
+void test_synth() {
+    std::cout << "Testing meet in the middle synthesis...\n";
+    const std::vector<packed_layer> layers = build_layers(6);
+    auto depth_of = [&](const SO6 &S) {
+        for (int T = 0; T < (int) layers.size(); ++T)
+            if (layers[T].contains(S)) return T;
+        return -1;
+    };
+
+    std::mt19937 rng(7);
+    bool minimal = true, reproduces = true, inverse_same = true, transpose_round_trip = true;
+    for (int trial = 0; trial < 6; ++trial) {
+        std::string circuit;
+        for (int g = 0; g < 6; ++g) circuit += std::to_string(rng() % 15) + " ";
+        SO6 target;
+        synth::parse(circuit, target);
+        const synth::result r = synth::query(target, 6);
+        minimal &= r.found && r.T == depth_of(target);
+        reproduces &= r.found && (SO6::reconstruct_from_circuit_string(r.circuit) <=> target) == 0;
+        inverse_same &= synth::query(target.transpose(), 6).T == r.T;
+        transpose_round_trip &= (target.transpose().transpose() <=> target) == 0;
+    }
+    print_test("Query Finds Least T Count", minimal);
+    print_test("Query Circuit Reproduces Target", reproduces);
+    print_test("Inverse Has The Same T Count", inverse_same && transpose_round_trip);
+
+    std::ostringstream printed;
+    printed << layers[4][layers[4].size() / 2];
+    std::string line = printed.str();
+    std::replace(line.begin(), line.end(), '\n', ' ');
+    SO6 parsed;
+    print_test("Query Parses Printed Matrix", synth::parse(line, parsed) && synth::query(parsed, 6).T == 4);
+
+    auto identity_with = [](const std::string &first) {
+        std::string m = first;
+        for (int n = 1; n < 36; ++n) m += n % 7 == 0 ? " 1,0e0" : " 0,0e0";
+        return m;
+    };
+    bool rejected = synth::parse(identity_with("1,0e0"), parsed);
+    for (const std::string bad : {"99999999999,0e0", "300,0e0", "1,0e-200", "2,1e1", "0,0e3", "1,0e1", "-1,1e1"})
+        rejected &= !synth::parse(identity_with(bad), parsed);
+    print_test("Query Rejects Invalid Matrices", rejected);
+}
+
+void test_server() {
+    std::cout << "Testing resident synthesis server...\n";
+    std::mt19937 rng(11);
+    std::vector<std::string> circuits;
+    std::vector<int> fresh;
+    for (int trial = 0; trial < 4; ++trial) {
+        std::string circuit;
+        for (int g = 0; g < 7; ++g) circuit += std::to_string(rng() % 15) + " ";
+        circuits.push_back(circuit);
+        SO6 target;
+        synth::parse(circuit, target);
+        fresh.push_back(synth::query(target, 7).T);
+    }
+
+    synth::prepare(3, false);
+    bool same = synth::resident_depth() == 3;
+    for (size_t i = 0; i < circuits.size(); ++i) {
+        SO6 target;
+        synth::parse(circuits[i], target);
+        const synth::result r = synth::query(target, 7);
+        same &= r.T == fresh[i] && (SO6::reconstruct_from_circuit_string(r.circuit) <=> target) == 0;
+    }
+    print_test("Resident Query Matches Fresh Query", same);
+
+    int requests[2], replies[2];
+    bool piped = pipe(requests) == 0 && pipe(replies) == 0;
+    const std::string input = circuits[0] + "\nnot a circuit\n\nSTATS\n" + circuits[1] + "\nQUIT\n";
+    piped &= write(requests[1], input.data(), input.size()) == (ssize_t) input.size();
+    close(requests[1]);
+    server::reset();
+    const bool shutdown = server::session(requests[0], replies[1], 7);
+    close(replies[1]);
+    std::string output;
+    char buffer[4096];
+    for (ssize_t n; (n = read(replies[0], buffer, sizeof(buffer))) > 0; ) output.append(buffer, n);
+    close(requests[0]);
+    close(replies[0]);
+    std::istringstream lines(output);
+    std::string first, second, end, stats, last;
+    getline(lines, first);
+    getline(lines, second);
+    getline(lines, end);
+    getline(lines, stats);
+    const bool rest = !getline(lines, last);     // QUIT drops the unterminated second batch
+    print_test("Session Answers Batches", piped && !shutdown && first.rfind("OK " + std::to_string(fresh[0]) + " ", 0) == 0
+                                         && second.rfind("ERR", 0) == 0 && end.rfind("END 2 ", 0) == 0);
+    print_test("Session Reports Latency", stats.rfind("STATS queries=1 ", 0) == 0 && rest);
+
+    // A client that hangs up before its reply, after a target whose entries overflow an int
+    int pair[2];
+    bool hung_up = socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0;
+    const std::string hang_up = "99999999999,0e0\n" + circuits[2] + "\n\n";
+    hung_up &= write(pair[1], hang_up.data(), hang_up.size()) == (ssize_t) hang_up.size();
+    close(pair[1]);
+    hung_up &= !server::session(pair[0], pair[0], 7);     // Returns instead of dying of SIGPIPE or an exception
+    close(pair[0]);
+    print_test("Session Survives A Client Hanging Up", hung_up);
+
+    // SHUTDOWN from one client ends the session of another that is idle before the server returns
+    const std::string path = "/tmp/test_server.sock";
+    server::reset();
+    std::thread serving([&] { server::serve_socket(path, 7); });
+    auto connect_client = [&] {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::copy(path.begin(), path.end(), address.sun_path);
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        for (int attempt = 0; attempt < 500 && connect(fd, (sockaddr *) &address, sizeof(address)) != 0; ++attempt)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));     // Until the server listens
+        return fd;
+    };
+    const int idle = connect_client(), stopper = connect_client();
+    const timeval wait{5, 0};
+    setsockopt(idle, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));     // A session left running would block this read
+    const std::string ask = "STATS\n";
+    bool woken = write(idle, ask.data(), ask.size()) == (ssize_t) ask.size() && read(idle, buffer, sizeof(buffer)) > 0;
+    const std::string stop = "SHUTDOWN\n";
+    woken &= write(stopper, stop.data(), stop.size()) == (ssize_t) stop.size();
+    serving.join();
+    woken &= read(idle, buffer, sizeof(buffer)) == 0;
+    close(idle);
+    close(stopper);
+    print_test("Shutdown Ends Every Session", woken);
+    server::reset();
+    synth::release();
+}
+
+void test_symmetry() {
+    std::cout << "Testing transpose symmetry...\n";
+    std::vector<packed_layer> full, reps;
+    for (const bool on : {false, true}) {
+        symmetry::enable(on);
+        (on ? reps : full) = build_layers(6);
+    }
+    symmetry::enable(false);
+
+    bool closed = true, circuits = true, fewer = reps[6].size() < full[6].size();
+    size_t self_inverse = 0;
+    for (int T = 0; T <= 6; ++T) {
+        std::set<SO6> both;
+        for (const SO6 &S : reps[T]) {
+            SO6 s = S, t = S.transpose();
+            both.insert(S);
+            both.insert(t);
+            self_inverse += symmetry::self_inverse(S);
+            // The transposed history must still be a circuit of the transposed class
+            for (SO6 *M : {&s, &t})
+                circuits &= (SO6::reconstruct_from_circuit_string(M->hist.empty() ? "" : M->circuit_string()) <=> *M) == 0;
+        }
+        closed &= std::equal(both.begin(), both.end(), full[T].begin(), full[T].end(), [](const SO6 &a, const SO6 &b) { return (a <=> b) == 0; });
+    }
+    print_test("Representatives Close To Full Layers", closed && fewer);
+    print_test("Transpose Keeps Circuits", circuits);
+    print_test("Identity Is Self Inverse", symmetry::self_inverse(SO6::identity()) && self_inverse > 1);
+}
+
+void test_prune() {
+    std::cout << "Testing skipped children...\n";
+    // T_0 commutes with T_9, so both cancel: T_0 T_9 T_0 is T_9 up to a signed permutation
+    const uint16_t mask = SO6::reconstruct_from_circuit_string("0 9").cancelling_gates();
+    print_test("Commuting T Matrices Cancel", mask == (1 << 0 | 1 << 9) && SO6::reconstruct_from_circuit_string("0 1").cancelling_gates() == 1 << 1);
+    print_test("Cancelled Child In Earlier Class", (SO6::reconstruct_from_circuit_string("0 9 0") <=> SO6::reconstruct_from_circuit_string("9")) == 0);
+
+    // The identity maps every plane to every other; one T matrix leaves the planes {0,1}, {0,x} and {x,y} for x, y > 1
+    SO6 I = SO6::identity();
+    I.canonical_form();
+    const SO6 T0 = SO6::identity().left_multiply_by_T(0);
+    print_test("Automorphism Orbits Of Planes", I.row_orbit_gates == 1 && T0.row_orbit_gates == (1 << 0 | 1 << 1 | 1 << 9)
+                                                && T0.col_orbit_gates == T0.row_orbit_gates);
+    bool same_class = true;
+    for (int T = 1; T < 15; ++T) same_class &= (I.left_multiply_by_T(T) <=> I.left_multiply_by_T(0)) == 0;
+    print_test("Orbit Children Share A Class", same_class);
+
+    std::vector<packed_layer> layers[2];
+    uint64_t skipped = 0;
+    for (const bool on : {false, true}) {
+        bfs::prune(on);
+        run_stats::reset();
+        layers[on] = build_layers(7);
+        if (on) skipped = run_stats::sum().pruned;
+    }
+    bool same = true;
+    for (int T = 0; T <= 7; ++T)
+        same &= std::equal(layers[0][T].begin(), layers[0][T].end(), layers[1][T].begin(), layers[1][T].end(),
+                           [](const SO6 &a, const SO6 &b) { return (a <=> b) == 0; });
+    print_test("Pruning Keeps Layers", same && skipped > 0);
+    run_stats::reset();
+}
+
+void test_layer_arena() {
+    std::cout << "Testing layer arenas...\n";
+    layer_arena arena;
+    char *a = static_cast<char *>(arena.allocate(100, 8));
+    char *b = static_cast<char *>(arena.allocate(24, 64));
+    char *large = static_cast<char *>(arena.allocate(layer_arena::CHUNK, 8));
+    std::fill(large, large + layer_arena::CHUNK, 1);   // Large allocations get a mapping of their own
+    char *c = static_cast<char *>(arena.allocate(3, 1));     // As a container rebound to bytes asks
+    char *d = static_cast<char *>(arena.allocate(8, 1));
+    print_test("Arena Alignment", reinterpret_cast<uintptr_t>(b) % 64 == 0 && b >= a + 100
+                                  && reinterpret_cast<uintptr_t>(d) % alignof(std::max_align_t) == 0 && d >= c + 3);
+    print_test("Arena Reserved", arena.chunk_count() == 1 && arena.reserved() == 2 * layer_arena::CHUNK);
+    arena.reset();
+    print_test("Arena Reuses Chunks After Reset", arena.allocate(100, 8) == a && arena.reserved() == layer_arena::CHUNK);
+
+    // Layers built in a reset arena match those built on the heap, and their matrices keep their circuits
+    std::vector<std::unique_ptr<layer_arena>> arenas;
+    arenas.push_back(std::make_unique<layer_arena>());
+    const std::vector<packed_layer> heap = build_layers(7);
+    size_t built = 0;
+    const std::vector<packed_layer> layers = build_layers(7, [](SO6 &) {}, std::move(bfs::next_layers(arenas)[0]),
+                                                          [&](const bfs::node_set &next) { built += next.get_allocator().owner == arenas[0].get(); });
+    bool same = built == 7, circuits = true;
+    for (int T = 1; T <= 7; ++T) {
+        same &= std::equal(layers[T].begin(), layers[T].end(), heap[T].begin(), heap[T].end(),
+                           [](const SO6 &x, const SO6 &y) { return (x <=> y) == 0; });
+        SO6 last = layers[T][layers[T].size() - 1];
+        circuits &= (SO6::reconstruct_from_circuit_string(last.circuit_string()) <=> last) == 0;
+    }
+    print_test("Arena Layers Match Heap Layers", same);
+    print_test("Moved Matrices Keep Their Circuits", circuits);
+    print_test("Arena Reused Across Layers", arenas[0]->chunk_count() == 1);
+}
+
+void test_packed_layer() {
+    std::cout << "Testing packed layers...\n";
+    std::mt19937 g(23);
+    std::vector<SO6> matrices = {SO6::identity()};
+    packed_layer packed;
+    packed.push_back(matrices[0]);
+    const packed_layer::layout narrow = packed.format();
+    for (int walk = 0; walk < 300; ++walk) {    // The identity first, so later matrices widen the records
+        SO6 S = SO6::identity();
+        for (int step = 0, length = 1 + g() % 10; step < length; ++step) S = S.left_multiply_by_T(g() % 15);
+        matrices.push_back(S);
+        packed.push_back(S);
+    }
+    bool exact = true, children = true;
+    for (size_t i = 0; i < matrices.size(); ++i) {
+        const SO6 &S = matrices[i], P = packed[i];
+        for (int r = 0; r < 6; ++r)
+            for (int c = 0; c < 6; ++c) exact &= P.get_element(r, c) == S.get_element(r, c);
+        exact &= P.hist == S.hist && P.fingerprint() == S.fingerprint() && packed.fingerprint(i) == S.fingerprint();
+        const int T = g() % 15;
+        const SO6 a = P.left_multiply_by_T(T), b = S.left_multiply_by_T(T);
+        children &= (a <=> b) == 0 && a.hist == b.hist;
+    }
+    print_test("Packed Records Round Trip", exact && packed.size() == matrices.size());
+    print_test("Unpacked Matrices Have The Same Children", children);
+    print_test("Packed Records Widen", !(packed.format() == narrow) && packed.record_bytes() < sizeof(SO6));
+
+    bool ordered = true;
+    for (int trial = 0; trial < 2000; ++trial) {
+        const size_t i = g() % matrices.size(), j = g() % matrices.size();
+        ordered &= packed.compare(i, matrices[j]) == (matrices[i] <=> matrices[j]);
+    }
+    print_test("Packed Order Matches Matrices", ordered);
+
+    packed.shuffle(g);
+    packed.sort();
+    bool sorted = true, found = true;
+    for (size_t i = 1; i < packed.size(); ++i) sorted &= packed.compare(i, packed.matrix(i - 1)) >= 0;
+    for (const SO6 &S : matrices) found &= packed.contains(S);
+    const SO6 outside = SO6::reconstruct_from_circuit_string("0 1 2 3 4 5 6 7 8 9 10 11 12 13");
+    print_test("Sorted Packed Layer Search", sorted && found && !packed.contains(outside));
+}
+
+void test_memory() {
+    std::cout << "Testing memory accounting...\n";
+    memory::reset();
+    std::vector<std::unique_ptr<layer_arena>> arenas;
+    arenas.push_back(std::make_unique<layer_arena>());
+    std::vector<memory::usage> sets = {{}};    // Each layer's set just before it is packed
+    const std::vector<packed_layer> layers = build_layers(5, [](SO6 &) {}, std::move(bfs::next_layers(arenas)[0]), [&](const bfs::node_set &next) {
+        sets.push_back({next.size(), arenas[0]->used() + memory::heap_bytes(next)});
+    });
+    const packed_layer &prior = layers[4], &current = layers[5];
+    for (int T = 1; T <= 5; ++T) {
+        memory::track(memory::NEXT, sets[T].elements, sets[T].bytes);
+        memory::track(memory::PRIOR, layers[T - 1].size(), layers[T - 1].bytes());
+        memory::track(memory::CURRENT, layers[T].size(), layers[T].bytes());
+        memory::take(T);
+    }
+    const memory::usage building = memory::of(memory::NEXT);
+    print_test("Memory Counts The Layer Being Built", building.elements == 77 && building.bytes > 77 * (sizeof(SO6) + SO6::identity().heap_bytes())
+                                                     && building.bytes < layer_arena::CHUNK);
+    print_test("Memory Sums Layers", memory::sum(std::vector<packed_layer>{prior, current}).bytes == prior.bytes() + current.bytes());
+    print_test("Memory Projects The Next Layer", memory::project() > memory::tracked() + 3 * building.bytes);
+
+    const std::string line = memory::summary(), written = memory::json();
+    print_test("Memory Summary And JSON", line.rfind("prior ", 0) == 0 && line.find("next layer about") != std::string::npos
+                                          && written.find("\"layers\": [{\"T\": 1, \"prior\"") != std::string::npos);
+    print_test("Peak Resident Set", memory::rss() > 0 && memory::peak_rss() >= memory::rss());
+    memory::reset();
+    print_test("Memory Reset", memory::tracked() == 0 && memory::project() == 0);
+}
+
+void test_budget() {
+    std::cout << "Testing memory budget...\n";
+    print_test("Budget Parses Sizes", budget::parse("48G") == 48ull << 30 && budget::parse("512MB") == 512ull << 20
+                                      && budget::parse("1.5k") == 1536 && budget::parse("4096") == 4096);
+    bool rejected = true;
+    for (const std::string spec : {"", "G", "12X", "0M", "-3G", "5GiB"}) {
+        try {
+            budget::parse(spec);
+            rejected = false;
+        } catch (const std::invalid_argument &) {}
+    }
+    print_test("Budget Rejects Bad Sizes", rejected);
+
+    // Layers growing tenfold from T=3, with a target of T=10
+    const std::vector<uint64_t> sizes = {1, 15, 200, 2000};
+    const budget::plan deep = budget::best(sizes, 1e-9, 1e-3, 1000, 1ull << 40, 10);
+    print_test("Budget Stores Deeper When Products Dominate", deep.depth > 3 && deep.seconds < deep.stop_seconds && deep.peak >= 1000);
+    print_test("Budget Stops When Nodes Dominate", budget::best(sizes, 1.0, 1e-12, 1000, 1ull << 40, 10).depth == 3);
+    print_test("Budget Stops When The Next Layer Does Not Fit", budget::best(sizes, 1e-9, 1e-3, 1000, 999, 10).depth == 3);
+
+    budget::configure(1);
+    print_test("Budget Stores At Least Half The Target", budget::active() && budget::lowest_depth(10) == 5 && budget::lowest_depth(9) == 5
+                                                         && budget::keep_storing(3, 10, 1ull << 40) && !budget::describe().empty());
+    print_test("Budget Stops Before The Target", !budget::keep_storing(9, 10, 0));
+    budget::reset();
+    print_test("Budget Reset", !budget::active());
+}
+
 Z2 rand_z2(bool flag = true) {
     std::random_device rd;
     std::mt19937 g(rd());
@@ -355,6 +1309,28 @@ int main(int argc, char **argv) {
 
 
     test_uint72_t(); // Run tests for uint72_t
+    test_pattern_transforms(); // Run tests for bit-sliced pattern transforms
+    test_incremental_pattern(); // Run tests for the LDE and pattern cached in SO6
+    test_pattern_io(); // Run tests for pattern file parsing and binary records
+    test_batch_case_num(); // Run tests for scalar and batch case classification
+    test_bfs(); // Run tests for the work-stealing layer expansion
+    test_pipeline(); // Run tests for the staged layer expansion
+    test_result_writer(); // Run tests for the asynchronous text and binary writers
+    test_circuit_io(); // Run tests for reading and converting circuit files
+    test_block_codec(); // Run tests for the compressed block codec
+    test_shard(); // Run tests for shard slices and coverage merging
+    test_run_stats(); // Run tests for the per-thread counters and stats file
+    test_balance(); // Run tests for the cost-aware free multiply schedule
+    test_tiling(); // Run tests for products and their cache-blocked order
+    test_join(); // Run tests for the targeted join of generators and stored matrices
+    test_synth(); // Run tests for meet in the middle synthesis queries
+    test_server(); // Run tests for resident layers and the server's line protocol
+    test_symmetry(); // Run tests for layers stored one matrix per inverse pair
+    test_prune(); // Run tests for skipping children that cancel a T matrix or repeat a sibling's class
+    test_layer_arena(); // Run tests for bump allocated layers and their rotation
+    test_packed_layer(); // Run tests for bit-packed layer records
+    test_memory(); // Run tests for memory accounting
+    test_budget(); // Run tests for the memory budget
 
     pattern pat;
     for(int row = 0; row < 6; row ++) for(int col = 0; col < 6; col++) {
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include "tiling.hpp"
+
+tiling::shape tiling::current = {1, 1};
+
+/**
+ * @brief Reads the data cache sizes, falling back to common sizes where the system does not report them.
+ */
+tiling::cache_sizes tiling::detect() {
+    auto level = [](const int name, const size_t fallback) {
+        const long size = sysconf(name);
+        return size > 0 ? static_cast<size_t>(size) : fallback;
+    };
+    return {level(_SC_LEVEL1_DCACHE_SIZE, 32 << 10), level(_SC_LEVEL2_CACHE_SIZE, 1 << 20), level(_SC_LEVEL3_CACHE_SIZE, 8 << 20)};
+}
+
+std::string tiling::describe(const cache_sizes &caches) {
+    return "L1 " + std::to_string(caches.l1 >> 10) + "KiB, L2 " + std::to_string(caches.l2 >> 10) + "KiB, L3 "
+           + std::to_string(caches.l3 >> 20) + "MiB";
+}
+
+/**
+ * @brief The tile shapes worth timing for a generating set on these caches.
+ *
+ * Generator tiles fill half of L1, half of L2, all of L2 or a thread's share of L3, and blocks of
+ * stored matrices fill half of L1 or hold a few matrices. The untiled order comes first, then the
+ * tiles that fill half of L2 with blocks that fill half of L1.
+ *
+ * @param caches The cache sizes.
+ * @param generators Number of generators.
+ * @param bytes Size of one packed record of the operands.
+ */
+std::vector<tiling::shape> tiling::candidates(const cache_sizes &caches, const size_t generators, const size_t bytes) {
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    auto fit = [&](const size_t cache) { return std::clamp<size_t>(cache / bytes, 1, std::max<size_t>(1, generators)); };
+
+    std::vector<shape> shapes = {untiled(generators)};
+    for (const size_t tile : {fit(caches.l2 / 2), fit(caches.l1 / 2), fit(caches.l2), fit(caches.l3 / threads)}) {
+        for (const size_t block : {fit(caches.l1 / 2), size_t(4)}) {
+            const shape s = {tile, block};
+            if (std::none_of(shapes.begin(), shapes.end(), [&](const shape &o) { return o.generators == s.generators && o.stored == s.stored; }))
+                shapes.push_back(s);
+        }
+    }
+    return shapes;
+}
+
+/**
+ * @brief Picks the fastest tile shape for a generating set by timing each candidate on a sample.
+ *
+ * Generating sets that fit in half of L2 are multiplied untiled, since they already stay in cache,
+ * and layers too small to repay the timing take the tile that fills half of L2 untimed.
+ *
+ * @param generators The generating set.
+ * @param stored The stored matrices.
+ * @return The fastest shape.
+ */
+tiling::shape tiling::tune(const packed_layer &generators, const packed_layer &stored) {
+    const cache_sizes caches = detect();
+    const size_t bytes = generators.record_bytes();
+    if (generators.size() * bytes <= caches.l2 / 2 || stored.empty()) return untiled(generators.size());
+
+    const size_t g_count = std::min(generators.size(), TUNE_GENERATORS);
+    const size_t s_count = std::min(stored.size(), TUNE_STORED);
+    const std::vector<shape> shapes = candidates(caches, generators.size(), bytes);
+    if (generators.size() * stored.size() < TUNE_PAYOFF * shapes.size() * g_count * s_count)
+        return shapes[1];     // Timing would cost more than it saves, take half of L2 and half of L1
+
+    shape best = untiled(generators.size());
+    double best_time = 0;
+    uint64_t acc = 0;
+    for (const shape &s : shapes) {
+        const shape sample = {std::min(s.generators, g_count), s.stored};
+        const auto start = std::chrono::steady_clock::now();
+        for_each_tile(s_count, g_count, sample, [&](const size_t i, const size_t g_begin, const size_t g_end) {
+            const SO6 S = stored.matrix(i);
+            for (size_t g = g_begin; g < g_end; ++g) acc ^= (generators.matrix(g) * S).pattern_bits().low_bits;
+        });
+        const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (best_time == 0 || time < best_time) {
+            best_time = time;
+            best = s;
+        }
+    }
+    asm volatile("" : : "g"(acc));     // Keeps the timed products from being optimized away
+    return best;
+}
@@ -0,0 +1,70 @@
+#ifndef TILING_HPP
+#define TILING_HPP
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "SO6.hpp"
+#include "packed_layer.hpp"
+
+/**
+ * @file tiling.hpp
+ * @brief Cache-blocked order of the products of a generating set and the stored matrices.
+ *
+ * Multiplying every stored matrix by the whole generating set streams the generating set from
+ * memory once per stored matrix as soon as it no longer fits in cache. Instead, a block of stored
+ * matrices small enough to stay in L1 is multiplied by one tile of generators sized to stay in L2,
+ * then by the next tile, so each generator is loaded from memory once per block rather than once
+ * per stored matrix.
+ *
+ * Block and tile sizes start from the detected cache sizes and are tuned by timing a few
+ * candidates on a sample of the real operands.
+ */
+class tiling {
+public:
+    struct cache_sizes {
+        size_t l1;
+        size_t l2;
+        size_t l3;
+    };
+
+    struct shape {
+        size_t generators;  // Generators per tile
+        size_t stored;      // Stored matrices per block
+    };
+
+    static constexpr size_t TUNE_STORED = 16;          // Stored matrices timed per candidate
+    static constexpr size_t TUNE_GENERATORS = 1 << 14;  // Most generators timed per candidate
+    static constexpr size_t TUNE_PAYOFF = 20;           // Layers must have this many times the timed products to be tuned
+
+    static cache_sizes detect();
+    static std::vector<shape> candidates(const cache_sizes &caches, const size_t generators, const size_t bytes);
+    static shape tune(const packed_layer &generators, const packed_layer &stored);
+    static shape untiled(const size_t generators) { return {std::max<size_t>(1, generators), 1}; }
+    static void set(const shape &s) { current = s; }
+    static shape get() { return current; }
+    static std::string describe(const cache_sizes &caches);
+
+    /**
+     * @brief Visits every (stored matrix, generator range) pair of a block of stored matrices in tile order.
+     * @param count Number of stored matrices.
+     * @param generators Number of generators.
+     * @param s The block and tile sizes.
+     * @param f Called with the index of a stored matrix and the first and one past the last generator of a tile.
+     */
+    template <typename F>
+    static void for_each_tile(const size_t count, const size_t generators, const shape &s, F &&f) {
+        for (size_t s_begin = 0; s_begin < count; s_begin += s.stored) {
+            const size_t s_end = std::min(count, s_begin + s.stored);
+            for (size_t g_begin = 0; g_begin < generators; g_begin += s.generators) {
+                const size_t g_end = std::min(generators, g_begin + s.generators);
+                for (size_t i = s_begin; i < s_end; ++i) f(i, g_begin, g_end);
+            }
+        }
+    }
+
+private:
+    static shape current;
+};
+
+#endif // TILING_HPP
@@ -98,6 +98,19 @@ public:
         return uint72_t(low_bits | other.low_bits, high_bits | other.high_bits);
     }
 
+    constexpr uint72_t operator^(const uint72_t& other) const {
+        return uint72_t(low_bits ^ other.low_bits, high_bits ^ other.high_bits);
+    }
+
+    // Pack into a single 128-bit register so masked shifts never branch on the 64-bit boundary
+    constexpr unsigned __int128 as_uint128() const {
+        return (static_cast<unsigned __int128>(high_bits) << 64) | low_bits;
+    }
+
+    static constexpr uint72_t from_uint128(const unsigned __int128 value) {
+        return uint72_t(static_cast<uint64_t>(value), static_cast<uint8_t>(value >> 64));
+    }
+
     constexpr uint72_t operator<<(size_t shift) const {
         if (shift >= 72) {
             return uint72_t(0, 0); // All bits shifted out of range
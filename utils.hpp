@@ -5,6 +5,7 @@
 #include <tbb/concurrent_set.h>
 #include "Z2.hpp"
 #include "SO6.hpp"
+#include "packed_layer.hpp"
 #include "utils.hpp"
 
 /**
@@ -73,16 +74,36 @@ public:
         }
         
         s.clear(); // Clear the set after moving elements
-        
-        // Shuffle the vector
-        if (!v.empty()) {
-            static thread_local std::mt19937 g(std::random_device{}());
-            std::shuffle(v.begin(), v.end(), g);
-        }
-        
+        shuffle(v);
         return v; // Return the shuffled vector
     }
 
+    /**
+     * @brief Shuffles a vector of SO6s in place.
+     * @param v Vector to be shuffled.
+     */
+    static void shuffle(std::vector<SO6>& v) {
+        if (v.empty()) return;
+        static thread_local std::mt19937 g(std::random_device{}());
+        std::shuffle(v.begin(), v.end(), g);
+    }
+
+    /**
+     * @brief Shuffles the records of a packed layer in place.
+     * @param l Layer to be shuffled.
+     */
+    static void shuffle(packed_layer& l) {
+        if (l.empty()) return;
+        static thread_local std::mt19937 g(std::random_device{}());
+        l.shuffle(g);
+    }
+
+    /**
+     * @brief Converts a line of 36 comma separated pattern entries in 0-3 to a 72 character binary string.
+     * @param line The CSV line.
+     * @return The binary string.
+     * @throws std::invalid_argument if the line is not 36 entries in 0-3.
+     */
     static std::string convert_csv_line_to_binary(const std::string& line) {
         std::stringstream ss(line);
         std::string item;
@@ -90,11 +111,11 @@ public:
 
         while (std::getline(ss, item, ',')) {
             int number = std::stoi(item);
+            if (number < 0 || number > 3) throw std::invalid_argument("entry " + item + " is not in 0-3");
             binaryString += std::bitset<2>(number).to_string();
         }
         if(binaryString.length() !=72) {
-            std::cout << "shit.";
-            std::exit(0);
+            throw std::invalid_argument("expected 36 entries, found " + std::to_string(binaryString.length() / 2));
         }
         return binaryString;
     }